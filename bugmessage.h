@@ -4,14 +4,25 @@
 #include "common.h"
 #include "mymemory.h"
 
+/** @brief The kinds of bugs the model checker reports */
+enum bug_type {
+	BUG_USER_ASSERTION, /**< @brief The program's own assertion failed */
+	BUG_DATA_RACE,
+	BUG_DEADLOCK,
+	BUG_UNINIT_LOAD, /**< @brief A load may read an uninitialized atomic */
+	BUG_UNINIT_LOCK, /**< @brief A mutex was used before initialization */
+	NUM_BUG_TYPES
+};
+
 struct bug_message {
-	bug_message(const char *str) {
+	bug_message(enum bug_type type, const char *str) : type(type) {
 		const char *fmt = "  [BUG] %s\n";
 		msg = (char *)snapshot_malloc(strlen(fmt) + strlen(str));
 		sprintf(msg, fmt, str);
 	}
 	~bug_message() { if (msg) snapshot_free(msg); }
 
+	enum bug_type type;
 	char *msg;
 	void print() { model_print("%s", msg); }
 
@@ -0,0 +1,87 @@
+#!/bin/sh
+#
+# Checks that a bounded search whose bound covers every execution finds the
+# same behaviors as the unbounded search: the sets of program outputs must
+# match, as must whether any bug was found. A bounded search stops at the
+# first bound at which it finds a bug, so for a buggy program only the latter
+# is compared.
+# Syntax:
+#  ./check-bound.sh [-b BOUND] [-a ARGS] [test program...]
+#
+#  -b BOUND     The preemption and delay bound to check with (default: 50)
+#  -a ARGS      Model-checker options for every run (default: none)
+#
+# The numbers of executions depend on the order in which the alternatives are
+# explored, so they are not compared.
+#
+
+# Get the directory in which this script and the binaries are located
+BINDIR="${0%/*}"
+
+export LD_LIBRARY_PATH=${BINDIR}
+# For Mac OSX
+export DYLD_LIBRARY_PATH=${BINDIR}
+
+BOUND=50
+ARGS=
+
+while getopts "b:a:" opt; do
+	case $opt in
+		b) BOUND=$OPTARG ;;
+		a) ARGS=$OPTARG ;;
+		*) exit 2 ;;
+	esac
+done
+shift $((OPTIND - 1))
+
+if [ $# -eq 0 ]; then
+	set -- ${BINDIR}/test/insanesync.o ${BINDIR}/test/nestedpromise.o \
+		${BINDIR}/test/double-read-fv.o ${BINDIR}/test/mo-satcycle.o \
+		${BINDIR}/test/addr-satcycle.o ${BINDIR}/test/pending-release.o \
+		${BINDIR}/test/uninit.o ${BINDIR}/test/wrcs.o ${BINDIR}/test/iriw.o \
+		${BINDIR}/test/litmus/*.o
+fi
+
+# Print the distinct program outputs of a run (one line each, with '|'
+# between the lines of an output), whether it found a bug, and whether it
+# left any execution out
+outcomes() {
+	"$@" -v 2>&1 | awk '
+		/^---- BEGIN PROGRAM OUTPUT ----$/ { out = ""; inside = 1; next }
+		/^---- END PROGRAM OUTPUT   ----$/ { print "output: " out; inside = 0; next }
+		inside { out = out $0 "|"; next }
+		/^Number of buggy executions: / { print "buggy: " ($5 > 0) }
+		/executions beyond the bound were left out/ { print "left out" }
+		/^\*\*\*\*\*\*\* Model-checking complete: \*\*\*\*\*\*\*$/ { print "complete" }' | sort -u
+}
+
+FAILED=0
+for prog in "$@"; do
+	name=${prog#${BINDIR}/}
+	unbounded=$(outcomes "$prog" $ARGS)
+	if ! echo "$unbounded" | grep -q '^complete$'; then
+		echo "  $name: unbounded run failed"
+		FAILED=1
+		continue
+	fi
+	for bound in preemption delay; do
+		bounded=$(outcomes "$prog" $ARGS --$bound-bound=$BOUND)
+		expected=$unbounded
+		if echo "$bounded" | grep -q '^buggy: 1$'; then
+			bounded=$(echo "$bounded" | grep -v '^output: \|^left out$')
+			expected=$(echo "$unbounded" | grep -v '^output: ')
+		fi
+		if [ "$bounded" = "$expected" ]; then
+			echo "  $name --$bound-bound=$BOUND: ok ($(echo "$unbounded" | grep -c '^output: ') outputs)"
+		else
+			echo "  $name --$bound-bound=$BOUND: MISMATCH"
+			echo "$expected" > /tmp/check-bound.$$.a
+			echo "$bounded" | diff /tmp/check-bound.$$.a - | sed -n 's/^[<>] /      &/p'
+			rm -f /tmp/check-bound.$$.a
+			FAILED=1
+		fi
+	done
+done
+
+[ $FAILED -eq 0 ] && echo "OK" || echo "FAILED"
+exit $FAILED
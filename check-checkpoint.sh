@@ -0,0 +1,76 @@
+#!/bin/sh
+#
+# Checks that a search which is stopped partway (with -x) and then resumed
+# from its checkpoint (with -r) explores the same executions as an
+# uninterrupted search: all of the execution counts must match exactly
+# Syntax:
+#  ./check-checkpoint.sh [-C INTERVAL] [-a ARGS] [test program...]
+#
+#  -C INTERVAL  The checkpoint interval to check with (default: 3)
+#  -a ARGS      Model-checker options for every run (default: none)
+#
+# The first run stops once it has seen half of the complete executions of the
+# uninterrupted run.
+#
+
+# Get the directory in which this script and the binaries are located
+BINDIR="${0%/*}"
+
+export LD_LIBRARY_PATH=${BINDIR}
+# For Mac OSX
+export DYLD_LIBRARY_PATH=${BINDIR}
+
+INTERVAL=3
+ARGS=
+CHECKPOINT=${TMPDIR:-/tmp}/check-checkpoint.$$
+
+while getopts "C:a:" opt; do
+	case $opt in
+		C) INTERVAL=$OPTARG ;;
+		a) ARGS=$OPTARG ;;
+		*) exit 2 ;;
+	esac
+done
+shift $((OPTIND - 1))
+
+if [ $# -eq 0 ]; then
+	set -- ${BINDIR}/test/wrcs.o ${BINDIR}/test/bwsync.o ${BINDIR}/test/insanesync.o \
+		${BINDIR}/test/iriw.o ${BINDIR}/test/pending-release.o
+fi
+
+# Print the execution counts of a run (complete, redundant, buggy,
+# infeasible, total)
+count_executions() {
+	echo $("$@" 2>&1 | sed -n -e 's/^Number of [^:]*: //p' \
+		-e 's/^Total executions: //p')
+}
+
+FAILED=0
+for prog in "$@"; do
+	name=${prog#${BINDIR}/}
+	full=$(count_executions "$prog" $ARGS)
+	if [ -z "$full" ]; then
+		echo "  $name: uninterrupted run failed"
+		FAILED=1
+		continue
+	fi
+	half=$(( (${full%% *} + 1) / 2 ))
+	rm -f "$CHECKPOINT"
+	"$prog" $ARGS -x $half -c "$CHECKPOINT" -C $INTERVAL > /dev/null 2>&1
+	if [ ! -f "$CHECKPOINT" ]; then
+		echo "  $name -x $half: no checkpoint saved"
+		FAILED=1
+		continue
+	fi
+	resumed=$(count_executions "$prog" $ARGS -r "$CHECKPOINT")
+	if [ "$resumed" = "$full" ]; then
+		echo "  $name -x $half, resumed: ok ($full)"
+	else
+		echo "  $name -x $half, resumed: MISMATCH ($resumed, uninterrupted: $full)"
+		FAILED=1
+	fi
+done
+rm -f "$CHECKPOINT"
+
+[ $FAILED -eq 0 ] && echo "OK" || echo "FAILED"
+exit $FAILED
@@ -0,0 +1,65 @@
+#!/bin/sh
+#
+# Checks that a parallel (-j) search finds the same behaviors as the serial
+# search: the numbers of complete and buggy executions must match exactly
+# Syntax:
+#  ./check-parallel.sh [-j "JOBS..."] [-a ARGS] [test program...]
+#
+#  -j JOBS      The worker counts to check (default: "2 4 8")
+#  -a ARGS      Model-checker options for every run (default: none)
+#
+# The numbers of redundant and infeasible executions depend on the order in
+# which the alternatives are explored, so they are not compared.
+#
+
+# Get the directory in which this script and the binaries are located
+BINDIR="${0%/*}"
+
+export LD_LIBRARY_PATH=${BINDIR}
+# For Mac OSX
+export DYLD_LIBRARY_PATH=${BINDIR}
+
+JOBS="2 4 8"
+ARGS=
+
+while getopts "j:a:" opt; do
+	case $opt in
+		j) JOBS=$OPTARG ;;
+		a) ARGS=$OPTARG ;;
+		*) exit 2 ;;
+	esac
+done
+shift $((OPTIND - 1))
+
+if [ $# -eq 0 ]; then
+	set -- ${BINDIR}/test/wrcs.o ${BINDIR}/test/bwsync.o ${BINDIR}/test/insanesync.o
+fi
+
+# Print the complete and buggy execution counts of a run
+count_executions() {
+	echo $("$@" 2>&1 | sed -n -e 's/^Number of complete, bug-free executions: //p' \
+		-e 's/^Number of buggy executions: //p')
+}
+
+FAILED=0
+for prog in "$@"; do
+	name=${prog#${BINDIR}/}
+	serial=$(count_executions "$prog" $ARGS)
+	if [ -z "$serial" ]; then
+		echo "  $name: serial run failed"
+		FAILED=1
+		continue
+	fi
+	for j in $JOBS; do
+		parallel=$(count_executions "$prog" $ARGS -j "$j")
+		if [ "$parallel" = "$serial" ]; then
+			echo "  $name -j $j: ok (complete, buggy: $serial)"
+		else
+			echo "  $name -j $j: MISMATCH (complete, buggy: $parallel, serial: $serial)"
+			FAILED=1
+		fi
+	done
+done
+
+[ $FAILED -eq 0 ] && echo "OK" || echo "FAILED"
+exit $FAILED
@@ -0,0 +1,127 @@
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "checkpoint.h"
+#include "common.h"
+
+/**
+ * @brief Append raw data to a checkpoint under construction
+ * @param buf The checkpoint buffer
+ * @param data The data to append
+ * @param len The length of the data, in bytes
+ */
+void checkpoint_append(checkpoint_buf_t *buf, const void *data, size_t len)
+{
+	const char *bytes = (const char *)data;
+	buf->insert(buf->end(), bytes, bytes + len);
+}
+
+/**
+ * @brief Read raw data back out of a checkpoint
+ * @param cur The read cursor; advanced past the data
+ * @param data Returns the data
+ * @param len The length of the data, in bytes
+ * @return True on success; false if the checkpoint is truncated
+ */
+bool checkpoint_take(struct checkpoint_cursor *cur, void *data, size_t len)
+{
+	if ((size_t)(cur->end - cur->pos) < len)
+		return false;
+	memcpy(data, cur->pos, len);
+	cur->pos += len;
+	return true;
+}
+
+/**
+ * @brief Skip over data in a checkpoint
+ * @param cur The read cursor; advanced past the data
+ * @param len The length of the data, in bytes
+ * @return True on success; false if the checkpoint is truncated
+ */
+bool checkpoint_skip(struct checkpoint_cursor *cur, size_t len)
+{
+	if ((size_t)(cur->end - cur->pos) < len)
+		return false;
+	cur->pos += len;
+	return true;
+}
+
+/**
+ * @brief Write out a checkpoint
+ *
+ * The checkpoint is written to a temporary file which then replaces the
+ * target, so that a crash in the middle of writing leaves the previous
+ * checkpoint intact.
+ *
+ * @param filename The checkpoint file
+ * @param buf The contents of the checkpoint
+ * @return True on success
+ */
+bool checkpoint_write_file(const char *filename, const checkpoint_buf_t *buf)
+{
+	char tmpname[PATH_MAX];
+	if (snprintf(tmpname, sizeof(tmpname), "%s.tmp", filename) >= (int)sizeof(tmpname))
+		return false;
+
+	int fd = open(tmpname, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0)
+		return false;
+	const char *pos = buf->empty() ? NULL : &(*buf)[0];
+	size_t left = buf->size();
+	while (left > 0) {
+		ssize_t ret = write(fd, pos, left);
+		if (ret < 0 && errno == EINTR)
+			continue;
+		if (ret <= 0) {
+			close(fd);
+			unlink(tmpname);
+			return false;
+		}
+		pos += ret;
+		left -= ret;
+	}
+	if (fsync(fd) < 0 || close(fd) < 0) {
+		unlink(tmpname);
+		return false;
+	}
+	return rename(tmpname, filename) == 0;
+}
+
+/**
+ * @brief Read in a checkpoint
+ * @param filename The checkpoint file
+ * @param buf Returns the contents of the checkpoint
+ * @return True on success
+ */
+bool checkpoint_read_file(const char *filename, checkpoint_buf_t *buf)
+{
+	int fd = open(filename, O_RDONLY);
+	if (fd < 0)
+		return false;
+	struct stat st;
+	if (fstat(fd, &st) < 0) {
+		close(fd);
+		return false;
+	}
+	buf->resize(st.st_size);
+	char *pos = buf->empty() ? NULL : &(*buf)[0];
+	size_t left = buf->size();
+	while (left > 0) {
+		ssize_t ret = read(fd, pos, left);
+		if (ret < 0 && errno == EINTR)
+			continue;
+		if (ret <= 0) {
+			close(fd);
+			return false;
+		}
+		pos += ret;
+		left -= ret;
+	}
+	close(fd);
+	return true;
+}
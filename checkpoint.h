@@ -0,0 +1,39 @@
+/** @file checkpoint.h
+ *  @brief Saving and restoring the exploration state of a long run.
+ *
+ * A checkpoint records the cumulative stats and the NodeStack as it stood at
+ * the end of an execution. On resume, the path through the NodeStack is
+ * replayed (which rebuilds the may-read-from sets and other execution-specific
+ * state), and the saved exploration state is then laid back over each Node.
+ *
+ * Checkpoints use the native byte order and structure layout, so they can
+ * only be resumed by the same build of the model checker, running the same
+ * program with the same options.
+ */
+
+#ifndef __CHECKPOINT_H__
+#define __CHECKPOINT_H__
+
+#include <stddef.h>
+
+#include "stl-model.h"
+
+/** @brief Identifies a checkpoint file (and its format version) */
+#define CHECKPOINT_MAGIC "CDSCKPT1"
+
+typedef ModelVector<char> checkpoint_buf_t;
+
+/** @brief A cursor for reading back the contents of a checkpoint */
+struct checkpoint_cursor {
+	const char *pos;
+	const char *end;
+};
+
+void checkpoint_append(checkpoint_buf_t *buf, const void *data, size_t len);
+bool checkpoint_take(struct checkpoint_cursor *cur, void *data, size_t len);
+bool checkpoint_skip(struct checkpoint_cursor *cur, size_t len);
+
+bool checkpoint_write_file(const char *filename, const checkpoint_buf_t *buf);
+bool checkpoint_read_file(const char *filename, checkpoint_buf_t *buf);
+
+#endif /* __CHECKPOINT_H__ */
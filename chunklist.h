@@ -0,0 +1,319 @@
+/** @file chunklist.h
+ *  @brief A list stored as a chain of arrays.
+ */
+
+#ifndef __CHUNKLIST_H__
+#define __CHUNKLIST_H__
+
+#include <stddef.h>
+#include <string.h>
+#include <iterator>
+#include "mymemory.h"
+#include "common.h"
+
+/**
+ * @brief ChunkList chunk: a slice of a contiguous array of elements
+ *
+ * The elements of a chunk are data[begin] through data[end - 1]. Chunks
+ * are never empty while they are on a list.
+ */
+template<typename _Tp>
+struct chunklistnode {
+	struct chunklistnode<_Tp> *prev;
+	struct chunklistnode<_Tp> *next;
+	unsigned int begin;
+	unsigned int end;
+	unsigned int capacity;
+	_Tp data[1];
+};
+
+/**
+ * @brief A list for plain-old-data elements, which is stored as a chain of
+ * arrays (chunks)
+ *
+ * Supports the subset of the std::list interface needed for logs of
+ * actions: appending, and adding or removing at the front. Chunks double in
+ * size as the list grows, so that long lists need few allocations and
+ * iterating over them mostly walks through contiguous memory.
+ *
+ * Iterators are not as stable as std::list's:
+ * - push_back() and push_front() never move elements, so iterators to them
+ *   stay valid, but end() (and so rbegin()) moves: an end() taken before a
+ *   push_back() no longer marks the end of the list.
+ * - erase() shifts the later elements of the same chunk down, invalidating
+ *   every iterator to them, and end() if that chunk is the last. Only the
+ *   iterator it returns may be used afterwards.
+ * The action lists are only added to while nothing iterates over them (see
+ * ModelExecution::add_action_to_lists() and process_mutex()), and the one
+ * erase(), of a woken condition variable waiter, drops its iterator right
+ * away.
+ *
+ * By default it is snapshotting, but you can pass in your own allocation
+ * functions.
+ *
+ * @tparam _Tp     Type name for the elements; must be plain-old-data
+ * @tparam _malloc Provide your own 'malloc' for the list, or default to
+ *                 snapshotting.
+ * @tparam _free   Provide your own 'free' for the list, or default to
+ *                 snapshotting.
+ */
+template<typename _Tp, void * (* _malloc)(size_t) = snapshot_malloc, void (*_free)(void *) = snapshot_free>
+class ChunkList {
+	typedef struct chunklistnode<_Tp> node;
+
+	/** @brief Iterator, over either _Tp or const _Tp */
+	template<typename _Val>
+	class chunk_iterator {
+	public:
+		typedef std::bidirectional_iterator_tag iterator_category;
+		typedef _Tp value_type;
+		typedef ptrdiff_t difference_type;
+		typedef _Val * pointer;
+		typedef _Val & reference;
+
+		chunk_iterator() : chunk(NULL), index(0) { }
+		chunk_iterator(node *chunk, unsigned int index) : chunk(chunk), index(index) { }
+		/** @brief Conversion from a non-const iterator */
+		chunk_iterator(const chunk_iterator<_Tp> &it) : chunk(it.chunk), index(it.index) { }
+
+		reference operator*() const { return chunk->data[index]; }
+		pointer operator->() const { return &chunk->data[index]; }
+
+		chunk_iterator & operator++() {
+			if (++index == chunk->end && chunk->next) {
+				chunk = chunk->next;
+				index = chunk->begin;
+			}
+			return *this;
+		}
+		chunk_iterator operator++(int) {
+			chunk_iterator ret = *this;
+			++(*this);
+			return ret;
+		}
+		chunk_iterator & operator--() {
+			if (index == chunk->begin) {
+				chunk = chunk->prev;
+				index = chunk->end;
+			}
+			index--;
+			return *this;
+		}
+		chunk_iterator operator--(int) {
+			chunk_iterator ret = *this;
+			--(*this);
+			return ret;
+		}
+
+		bool operator==(const chunk_iterator &other) const {
+			return chunk == other.chunk && index == other.index;
+		}
+		bool operator!=(const chunk_iterator &other) const {
+			return !(*this == other);
+		}
+
+	private:
+		friend class ChunkList;
+		friend class chunk_iterator<const _Tp>;
+		node *chunk;
+		unsigned int index;
+	};
+
+ public:
+	typedef _Tp value_type;
+	typedef chunk_iterator<_Tp> iterator;
+	typedef chunk_iterator<const _Tp> const_iterator;
+	typedef std::reverse_iterator<iterator> reverse_iterator;
+	typedef std::reverse_iterator<const_iterator> const_reverse_iterator;
+
+	/** @brief Smallest (and first) chunk size, in elements */
+	static const unsigned int MIN_CHUNK = 4;
+	/** @brief Largest chunk size, in elements */
+	static const unsigned int MAX_CHUNK = 1024;
+
+	ChunkList() : head(NULL), tail(NULL), count(0) { }
+
+	ChunkList(const ChunkList &other) : head(NULL), tail(NULL), count(0) {
+		append(other);
+	}
+
+	ChunkList & operator=(const ChunkList &other) {
+		if (this != &other) {
+			clear();
+			append(other);
+		}
+		return *this;
+	}
+
+	/** @brief List destructor */
+	~ChunkList() {
+		clear();
+	}
+
+	/** Override: new operator */
+	void * operator new(size_t size) {
+		return _malloc(size);
+	}
+
+	/** Override: delete operator */
+	void operator delete(void *p, size_t size) {
+		_free(p);
+	}
+
+	/** Override: new[] operator */
+	void * operator new[](size_t size) {
+		return _malloc(size);
+	}
+
+	/** Override: delete[] operator */
+	void operator delete[](void *p, size_t size) {
+		_free(p);
+	}
+
+	/** Override: placement new operator */
+	void * operator new(size_t size, void *p) {
+		return p;
+	}
+
+	iterator begin() { return head ? iterator(head, head->begin) : iterator(); }
+	iterator end() { return tail ? iterator(tail, tail->end) : iterator(); }
+	const_iterator begin() const { return head ? const_iterator(head, head->begin) : const_iterator(); }
+	const_iterator end() const { return tail ? const_iterator(tail, tail->end) : const_iterator(); }
+	reverse_iterator rbegin() { return reverse_iterator(end()); }
+	reverse_iterator rend() { return reverse_iterator(begin()); }
+	const_reverse_iterator rbegin() const { return const_reverse_iterator(end()); }
+	const_reverse_iterator rend() const { return const_reverse_iterator(begin()); }
+
+	size_t size() const { return count; }
+	bool empty() const { return count == 0; }
+
+	_Tp & front() { return head->data[head->begin]; }
+	_Tp & back() { return tail->data[tail->end - 1]; }
+	const _Tp & front() const { return head->data[head->begin]; }
+	const _Tp & back() const { return tail->data[tail->end - 1]; }
+
+	/** @brief Add an element to the end of the list */
+	void push_back(const _Tp &val) {
+		if (!tail || tail->end == tail->capacity) {
+			unsigned int capacity = tail ? tail->capacity * 2 : MIN_CHUNK;
+			if (capacity > MAX_CHUNK)
+				capacity = MAX_CHUNK;
+			node *chunk = new_chunk(capacity, 0);
+			chunk->prev = tail;
+			if (tail)
+				tail->next = chunk;
+			else
+				head = chunk;
+			tail = chunk;
+		}
+		tail->data[tail->end++] = val;
+		count++;
+	}
+
+	/** @brief Add an element to the front of the list */
+	void push_front(const _Tp &val) {
+		if (!head || head->begin == 0) {
+			node *chunk = new_chunk(MIN_CHUNK, MIN_CHUNK);
+			chunk->next = head;
+			if (head)
+				head->prev = chunk;
+			else
+				tail = chunk;
+			head = chunk;
+		}
+		head->data[--head->begin] = val;
+		count++;
+	}
+
+	/** @brief Remove the first element of the list */
+	void pop_front() {
+		ASSERT(count > 0);
+		count--;
+		if (++head->begin == head->end)
+			remove_chunk(head);
+	}
+
+	/** @brief Remove the last element of the list */
+	void pop_back() {
+		ASSERT(count > 0);
+		count--;
+		if (--tail->end == tail->begin)
+			remove_chunk(tail);
+	}
+
+	/**
+	 * @brief Remove an element from the list
+	 *
+	 * Later elements in the same chunk shift down, so this is only meant
+	 * for occasional use.
+	 *
+	 * @param it The element to remove
+	 * @return An iterator to the element following the removed one
+	 */
+	iterator erase(iterator it) {
+		node *chunk = it.chunk;
+		unsigned int index = it.index;
+		memmove(&chunk->data[index], &chunk->data[index + 1], (chunk->end - index - 1) * sizeof(_Tp));
+		count--;
+		if (--chunk->end == chunk->begin) {
+			node *next = chunk->next;
+			remove_chunk(chunk);
+			return next ? iterator(next, next->begin) : end();
+		}
+		if (index == chunk->end && chunk->next)
+			return iterator(chunk->next, chunk->next->begin);
+		return iterator(chunk, index);
+	}
+
+	/** @brief Remove all elements from the list */
+	void clear() {
+		node *chunk = head;
+		while (chunk) {
+			node *next = chunk->next;
+			_free(chunk);
+			chunk = next;
+		}
+		head = tail = NULL;
+		count = 0;
+	}
+
+ private:
+	/**
+	 * @brief Allocate an (unlinked) chunk
+	 * @param capacity The number of elements the chunk can hold
+	 * @param begin The index at which the (empty) chunk's elements start
+	 */
+	static node * new_chunk(unsigned int capacity, unsigned int begin) {
+		node *chunk = (node *)_malloc(offsetof(node, data) + capacity * sizeof(_Tp));
+		chunk->prev = chunk->next = NULL;
+		chunk->begin = chunk->end = begin;
+		chunk->capacity = capacity;
+		return chunk;
+	}
+
+	/** @brief Unlink and free an (empty) chunk */
+	void remove_chunk(node *chunk) {
+		if (chunk->prev)
+			chunk->prev->next = chunk->next;
+		else
+			head = chunk->next;
+		if (chunk->next)
+			chunk->next->prev = chunk->prev;
+		else
+			tail = chunk->prev;
+		_free(chunk);
+	}
+
+	/** @brief Append copies of all of the elements of another list */
+	void append(const ChunkList &other) {
+		for (const node *chunk = other.head; chunk; chunk = chunk->next)
+			for (unsigned int i = chunk->begin; i < chunk->end; i++)
+				push_back(chunk->data[i]);
+	}
+
+	node *head;
+	node *tail;
+	size_t count;
+};
+
+#endif /* __CHUNKLIST_H__ */
@@ -6,6 +6,43 @@
 #include "common.h"
 #include "threads-model.h"
 
+/** @brief A reference-counted, shared chunk of a large ClockVector */
+struct ClockChunk {
+	/** @brief The number of ClockVectors sharing this chunk */
+	unsigned int refcount;
+	modelclock_t clock[CV_CHUNK_THREADS];
+};
+
+/**
+ * @brief Allocate a new (unshared) chunk
+ * @param orig The chunk whose clocks to copy, or NULL for all zeros
+ */
+static ClockChunk * new_chunk(const ClockChunk *orig)
+{
+	ClockChunk *chunk = (ClockChunk *)snapshot_malloc(sizeof(*chunk));
+	chunk->refcount = 1;
+	if (orig)
+		std::memcpy(chunk->clock, orig->clock, sizeof(chunk->clock));
+	else
+		std::memset(chunk->clock, 0, sizeof(chunk->clock));
+	return chunk;
+}
+
+/** @brief Take another reference to a chunk (which may be NULL) */
+static ClockChunk * share_chunk(ClockChunk *chunk)
+{
+	if (chunk)
+		chunk->refcount++;
+	return chunk;
+}
+
+/** @brief Drop a reference to a chunk (which may be NULL) */
+static void release_chunk(ClockChunk *chunk)
+{
+	if (chunk && --chunk->refcount == 0)
+		snapshot_free(chunk);
+}
+
 /**
  * Constructs a new ClockVector, given a parent ClockVector and a first
  * ModelAction. This constructor can assign appropriate default settings if no
@@ -14,24 +51,134 @@
  * same thread or the parent that created this thread)
  * @param act is an action with which to update the ClockVector
  */
-ClockVector::ClockVector(ClockVector *parent, const ModelAction *act)
+ClockVector::ClockVector(ClockVector *parent, const ModelAction *act) :
+	num_threads(0),
+	chunks(NULL)
 {
 	ASSERT(act);
-	num_threads = int_to_id(act->get_tid()) + 1;
-	if (parent && parent->num_threads > num_threads)
+	if (parent && parent->is_chunked()) {
+		/* Share all of the parent's chunks */
+		int n = parent->get_num_chunks();
+		if (n > CV_INLINE_CHUNKS)
+			chunks = (ClockChunk **)snapshot_malloc(n * sizeof(*chunks));
+		else
+			chunks = inline_chunks;
+		for (int i = 0; i < n; i++)
+			chunks[i] = share_chunk(parent->chunks[i]);
 		num_threads = parent->num_threads;
+	} else if (parent) {
+		std::memcpy(inline_clock, parent->inline_clock, parent->num_threads * sizeof(modelclock_t));
+		num_threads = parent->num_threads;
+	}
 
-	clock = (modelclock_t *)snapshot_calloc(num_threads, sizeof(int));
-	if (parent)
-		std::memcpy(clock, parent->clock, parent->num_threads * sizeof(modelclock_t));
-
-	clock[id_to_int(act->get_tid())] = act->get_seq_number();
+	int tid = id_to_int(act->get_tid());
+	if (tid >= num_threads)
+		grow(tid + 1);
+	if (is_chunked())
+		get_writable_chunk(tid / CV_CHUNK_THREADS)[tid % CV_CHUNK_THREADS] = act->get_seq_number();
+	else
+		inline_clock[tid] = act->get_seq_number();
 }
 
 /** @brief Destructor */
 ClockVector::~ClockVector()
 {
-	snapshot_free(clock);
+	if (!is_chunked())
+		return;
+	int n = get_num_chunks();
+	for (int i = 0; i < n; i++)
+		release_chunk(chunks[i]);
+	if (chunks != inline_chunks)
+		snapshot_free(chunks);
+}
+
+/** @return The number of chunks in a large vector */
+int ClockVector::get_num_chunks() const
+{
+	return (num_threads + CV_CHUNK_THREADS - 1) / CV_CHUNK_THREADS;
+}
+
+/**
+ * @brief Get a chunk for writing, first making a private copy if it is
+ * shared (or allocating it, if it is all zeros)
+ * @param index The index of the chunk
+ * @return The clock array of the chunk
+ */
+modelclock_t * ClockVector::get_writable_chunk(int index)
+{
+	ClockChunk *chunk = chunks[index];
+	if (!chunk || chunk->refcount > 1) {
+		ClockChunk *copy = new_chunk(chunk);
+		release_chunk(chunk);
+		chunks[index] = chunk = copy;
+	}
+	return chunk->clock;
+}
+
+/**
+ * @brief Extend this vector to cover more threads, whose clocks start at zero
+ * @param threads The new number of threads
+ */
+void ClockVector::grow(int threads)
+{
+	if (threads <= CV_INLINE_THREADS) {
+		for (int i = num_threads; i < threads; i++)
+			inline_clock[i] = 0;
+		num_threads = threads;
+		return;
+	}
+
+	int new_chunks = (threads + CV_CHUNK_THREADS - 1) / CV_CHUNK_THREADS;
+	if (is_chunked()) {
+		int old_chunks = get_num_chunks();
+		if (chunks != inline_chunks) {
+			chunks = (ClockChunk **)snapshot_realloc(chunks, new_chunks * sizeof(*chunks));
+		} else if (new_chunks > CV_INLINE_CHUNKS) {
+			chunks = (ClockChunk **)snapshot_malloc(new_chunks * sizeof(*chunks));
+			std::memcpy(chunks, inline_chunks, old_chunks * sizeof(*chunks));
+		}
+		for (int i = old_chunks; i < new_chunks; i++)
+			chunks[i] = NULL;
+		num_threads = threads;
+		return;
+	}
+
+	/* Switch from inline clocks to chunks (which share the same storage) */
+	modelclock_t old_clock[CV_INLINE_THREADS];
+	int old_threads = num_threads;
+	std::memcpy(old_clock, inline_clock, old_threads * sizeof(modelclock_t));
+	if (new_chunks > CV_INLINE_CHUNKS)
+		chunks = (ClockChunk **)snapshot_malloc(new_chunks * sizeof(*chunks));
+	else
+		chunks = inline_chunks;
+	for (int i = 0; i < new_chunks; i++)
+		chunks[i] = NULL;
+	num_threads = threads;
+	for (int i = 0; i < old_threads; i++)
+		if (old_clock[i] != 0)
+			get_writable_chunk(i / CV_CHUNK_THREADS)[i % CV_CHUNK_THREADS] = old_clock[i];
+}
+
+/**
+ * @brief Merge an array of clocks into one chunk of a large vector
+ * @param index The index of the chunk
+ * @param src The clocks to merge
+ * @param n The number of clocks to merge
+ * @return True if this vector changed
+ */
+bool ClockVector::merge_into_chunk(int index, const modelclock_t *src, int n)
+{
+	const ClockChunk *chunk = chunks[index];
+	unsigned int greater = 0;
+	for (int i = 0; i < n; i++)
+		greater |= src[i] > (chunk ? chunk->clock[i] : 0);
+	if (!greater)
+		return false;
+
+	modelclock_t *dst = get_writable_chunk(index);
+	for (int i = 0; i < n; i++)
+		dst[i] = src[i] > dst[i] ? src[i] : dst[i];
+	return true;
 }
 
 /**
@@ -42,21 +189,59 @@ ClockVector::~ClockVector()
 bool ClockVector::merge(const ClockVector *cv)
 {
 	ASSERT(cv != NULL);
-	bool changed = false;
-	if (cv->num_threads > num_threads) {
-		clock = (modelclock_t *)snapshot_realloc(clock, cv->num_threads * sizeof(modelclock_t));
-		for (int i = num_threads; i < cv->num_threads; i++)
-			clock[i] = 0;
-		num_threads = cv->num_threads;
+	if (cv->num_threads > num_threads)
+		grow(cv->num_threads);
+
+	if (!is_chunked()) {
+		/* Element-wise maximum, without branches (so that it vectorizes) */
+		modelclock_t *dst = inline_clock;
+		const modelclock_t *src = cv->inline_clock;
+		int n = cv->num_threads;
+		unsigned int changed = 0;
+		for (int i = 0; i < n; i++) {
+			modelclock_t greater = src[i] > dst[i];
+			changed |= greater;
+			dst[i] = greater ? src[i] : dst[i];
+		}
+		return changed != 0;
 	}
 
-	/* Element-wise maximum */
-	for (int i = 0; i < cv->num_threads; i++)
-		if (cv->clock[i] > clock[i]) {
-			clock[i] = cv->clock[i];
-			changed = true;
+	if (!cv->is_chunked()) {
+		bool changed = false;
+		for (int i = 0; i < cv->num_threads; i += CV_CHUNK_THREADS) {
+			int n = cv->num_threads - i;
+			if (n > CV_CHUNK_THREADS)
+				n = CV_CHUNK_THREADS;
+			changed |= merge_into_chunk(i / CV_CHUNK_THREADS, &cv->inline_clock[i], n);
 		}
-	
+		return changed;
+	}
+
+	bool changed = false;
+	int n = cv->get_num_chunks();
+	for (int i = 0; i < n; i++) {
+		ClockChunk *src = cv->chunks[i];
+		ClockChunk *dst = chunks[i];
+		if (!src || src == dst)
+			continue;
+
+		unsigned int src_greater = 0, dst_greater = 0;
+		for (int j = 0; j < CV_CHUNK_THREADS; j++) {
+			modelclock_t d = dst ? dst->clock[j] : 0;
+			src_greater |= src->clock[j] > d;
+			dst_greater |= d > src->clock[j];
+		}
+		if (!src_greater)
+			continue;
+		changed = true;
+		if (!dst_greater) {
+			/* The other chunk covers ours; share it */
+			release_chunk(dst);
+			chunks[i] = share_chunk(src);
+		} else {
+			merge_into_chunk(i, src->clock, CV_CHUNK_THREADS);
+		}
+	}
 	return changed;
 }
 
@@ -77,18 +262,21 @@ bool ClockVector::synchronized_since(const ModelAction *act) const
 	int i = id_to_int(act->get_tid());
 
 	if (i < num_threads)
-		return act->get_seq_number() <= clock[i];
+		return act->get_seq_number() <= getClock(act->get_tid());
 	return false;
 }
 
 /** Gets the clock corresponding to a given thread id from the clock vector. */
-modelclock_t ClockVector::getClock(thread_id_t thread) {
+modelclock_t ClockVector::getClock(thread_id_t thread) const
+{
 	int threadid = id_to_int(thread);
 
-	if (threadid < num_threads)
-		return clock[threadid];
-	else
+	if (threadid >= num_threads)
 		return 0;
+	if (!is_chunked())
+		return inline_clock[threadid];
+	const ClockChunk *chunk = chunks[threadid / CV_CHUNK_THREADS];
+	return chunk ? chunk->clock[threadid % CV_CHUNK_THREADS] : 0;
 }
 
 /** @brief Formats and prints this ClockVector's data. */
@@ -97,5 +285,5 @@ void ClockVector::print() const
 	int i;
 	model_print("(");
 	for (i = 0; i < num_threads; i++)
-		model_print("%2u%s", clock[i], (i == num_threads - 1) ? ")\n" : ", ");
+		model_print("%2u%s", getClock(int_to_id(i)), (i == num_threads - 1) ? ")\n" : ", ");
 }
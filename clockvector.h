@@ -10,7 +10,19 @@
 
 /* Forward declaration */
 class ModelAction;
-
+struct ClockChunk;
+
+/** @brief The number of chunk pointers which fit in ClockVector's inline storage */
+#define CV_INLINE_CHUNKS ((int)(CV_INLINE_THREADS * sizeof(modelclock_t) / sizeof(struct ClockChunk *)))
+
+/**
+ * @brief A clock vector
+ *
+ * Up to CV_INLINE_THREADS clocks are stored inline. Larger vectors are split
+ * into reference-counted chunks of CV_CHUNK_THREADS clocks, which are shared
+ * (copy-on-write) with the parent vector and with merged vectors, so that a
+ * new vector only stores the chunks in which it differs.
+ */
 class ClockVector {
 public:
 	ClockVector(ClockVector *parent = NULL, const ModelAction *act = NULL);
@@ -19,15 +31,32 @@ public:
 	bool synchronized_since(const ModelAction *act) const;
 
 	void print() const;
-	modelclock_t getClock(thread_id_t thread);
+	modelclock_t getClock(thread_id_t thread) const;
 
 	SNAPSHOTALLOC
 private:
-	/** @brief Holds the actual clock data, as an array. */
-	modelclock_t *clock;
+	bool is_chunked() const { return num_threads > CV_INLINE_THREADS; }
+	int get_num_chunks() const;
+	void grow(int threads);
+	modelclock_t * get_writable_chunk(int index);
+	bool merge_into_chunk(int index, const modelclock_t *src, int n);
 
-	/** @brief The number of threads recorded in clock (i.e., its length).  */
+	/** @brief The number of threads recorded in this vector */
 	int num_threads;
+
+	/**
+	 * @brief The chunks of a large vector; points to inline_chunks, or to
+	 * a separate array if there are too many chunks to fit there. A NULL
+	 * chunk holds all zeros.
+	 */
+	struct ClockChunk **chunks;
+
+	union {
+		/** @brief The clock data of a small vector */
+		modelclock_t inline_clock[CV_INLINE_THREADS];
+		/** @brief Storage for the chunk pointers of a large vector */
+		struct ClockChunk *inline_chunks[CV_INLINE_CHUNKS];
+	};
 };
 
 #endif /* __CLOCKVECTOR_H__ */
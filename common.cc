@@ -59,6 +59,37 @@ void model_assert(bool expr, const char *file, int line)
 
 static int fd_user_out; /**< @brief File descriptor from which to read user program output */
 
+/**
+ * @brief Program output moved out of the pipe by buffer_program_output()
+ *
+ * This is the output of the current execution up to its last mid-execution
+ * snapshot; it is kept across executions, since the next execution may resume
+ * from that snapshot.
+ */
+static ModelVector<char> *saved_output;
+
+/** @brief Redirect the user program's stdout to a new (nonblocking) pipe */
+static void redirect_program_output()
+{
+	int pipefd[2];
+	if (pipe(pipefd) < 0) {
+		perror("pipe");
+		exit(EXIT_FAILURE);
+	}
+	if (dup2(pipefd[1], STDOUT_FILENO) < 0) {
+		perror("dup2");
+		exit(EXIT_FAILURE);
+	}
+	close(pipefd[1]);
+
+	/* Save the "read" side of the pipe for use later */
+	if (fcntl(pipefd[0], F_SETFL, O_NONBLOCK) < 0) {
+		perror("fcntl");
+		exit(EXIT_FAILURE);
+	}
+	fd_user_out = pipefd[0];
+}
+
 /**
  * @brief Setup output redirecting
  *
@@ -88,24 +119,21 @@ void redirect_output()
 		exit(EXIT_FAILURE);
 	}
 
-	/* Redirect program output to a pipe */
-	int pipefd[2];
-	if (pipe(pipefd) < 0) {
-		perror("pipe");
-		exit(EXIT_FAILURE);
-	}
-	if (dup2(pipefd[1], STDOUT_FILENO) < 0) {
-		perror("dup2");
-		exit(EXIT_FAILURE);
-	}
-	close(pipefd[1]);
+	redirect_program_output();
+	saved_output = new ModelVector<char>();
+}
 
-	/* Save the "read" side of the pipe for use later */
-	if (fcntl(pipefd[0], F_SETFL, O_NONBLOCK) < 0) {
-		perror("fcntl");
-		exit(EXIT_FAILURE);
-	}
-	fd_user_out = pipefd[0];
+/**
+ * @brief Give this process a fresh pipe for the user program's output
+ *
+ * Used after fork(), so that a child does not share (and steal) program
+ * output with its parent or siblings.
+ */
+void reopen_program_output()
+{
+	fflush(stdout);
+	close(fd_user_out);
+	redirect_program_output();
 }
 
 /**
@@ -142,6 +170,36 @@ void clear_program_output()
 	while (read_to_buf(fd_user_out, buf, sizeof(buf)));
 }
 
+/**
+ * @brief Move any pending program output out of the pipe
+ *
+ * Used when taking a mid-execution snapshot: output produced before the
+ * snapshot must still be printed by executions which resume from it.
+ *
+ * @return The length of the program output buffered so far
+ */
+size_t buffer_program_output()
+{
+	char buf[200];
+	ssize_t ret;
+
+	fflush(stdout);
+	while ((ret = read_to_buf(fd_user_out, buf, sizeof(buf))) > 0)
+		saved_output->insert(saved_output->end(), buf, buf + ret);
+	return saved_output->size();
+}
+
+/**
+ * @brief Forget buffered program output when rolling back
+ * @param len The length of the program output buffered at the time of the
+ * snapshot we rolled back to
+ */
+void rewind_program_output(size_t len)
+{
+	ASSERT(len <= saved_output->size());
+	saved_output->resize(len);
+}
+
 /** @brief Print out any pending program output */
 void print_program_output()
 {
@@ -152,6 +210,16 @@ void print_program_output()
 	/* Gather all program output */
 	fflush(stdout);
 
+	/* Output saved before the last snapshot comes first */
+	for (size_t pos = 0; pos < saved_output->size(); ) {
+		ssize_t res = write(model_out, &(*saved_output)[pos], saved_output->size() - pos);
+		if (res < 0) {
+			perror("write");
+			exit(EXIT_FAILURE);
+		}
+		pos += res;
+	}
+
 	/* Read program output pipe and write to (real) stdout */
 	ssize_t ret;
 	while (1) {
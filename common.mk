@@ -10,6 +10,13 @@ LIB_SO := lib$(LIB_NAME).so
 
 CPPFLAGS += -Wall -O3 -g
 
+# Context switch between the model checker and the user threads: 'fast'
+# (hand-written; x86-64 only) or 'ucontext' (swapcontext())
+CONTEXT ?= fast
+ifeq ($(CONTEXT), ucontext)
+CPPFLAGS += -DUSE_FAST_CONTEXT=0
+endif
+
 CFLAGS := $(CPPFLAGS)
 
 # Mac OSX options
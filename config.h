@@ -32,6 +32,8 @@
 /** Snapshotting configurables */
 
 /** 
+ * If USE_MPROTECT_SNAPSHOT=3, then snapshot by tracking written pages with
+ * userfaultfd write-protection (requires Linux 6.7 or newer)
  * If USE_MPROTECT_SNAPSHOT=2, then snapshot by tuned mmap() algorithm
  * If USE_MPROTECT_SNAPSHOT=1, then snapshot by using mmap() and mprotect()
  * If USE_MPROTECT_SNAPSHOT=0, then snapshot by using fork() */
@@ -45,12 +47,54 @@
 
 /** Thread parameters */
 
-/* Size of stack to allocate for a thread. */
+/**
+ * If USE_FAST_CONTEXT=1, switch between the model checker and user threads
+ * with a hand-written context switch (x86-64 only; elsewhere, swapcontext()
+ * is always used)
+ * If USE_FAST_CONTEXT=0, switch with swapcontext(), which also saves and
+ * restores the signal mask on every switch */
+#ifndef USE_FAST_CONTEXT
+#define USE_FAST_CONTEXT 1
+#endif
+
+/* Default size of the stack of each user thread (see --stack-size). */
 #define STACK_SIZE (1024 * 1024)
 
 /** How many shadow tables of memory to preallocate for data race detector. */
 #define SHADOWBASETABLES 4
 
+/** Number of entries in the data race detector's shadow table lookup cache
+ *  (must be a power of two). */
+#define SHADOWCACHESIZE 16
+
+/** Number of thread clocks a ClockVector holds inline, without a separate
+ *  allocation. */
+#define CV_INLINE_THREADS 8
+
+/** Number of thread clocks in each of the (shared) chunks of a larger
+ *  ClockVector. */
+#define CV_CHUNK_THREADS 8
+
+/** Number of edges (in each direction) a CycleNode holds inline, without a
+ *  separate allocation. */
+#define CYCLENODE_INLINE_EDGES 4
+
+/** Largest number of CycleNodes stored in each contiguous block of a single
+ *  location's nodes. */
+#define CYCLENODE_MAX_BLOCK 64
+
+/** Parallel exploration parameters */
+
+/** Maximum number of worker processes for parallel exploration. */
+#define PARALLEL_MAX_WORKERS 256
+
+/** Number of entries in the shared table of claimed subtrees (must be a
+ *  power of two). */
+#define PARALLEL_CLAIM_TABLE_SIZE (1 << 20)
+
+/** Maximum length of a path handed between parallel workers. */
+#define PARALLEL_MAX_PATH 256
+
 /** Enable debugging assertions (via ASSERT()) */
 #define CONFIG_ASSERT
 
@@ -1,3 +1,5 @@
+#include <stdint.h>
+
 #include "context.h"
 
 #ifdef MAC
@@ -25,3 +27,136 @@ int model_swapcontext(ucontext_t *oucp, ucontext_t *ucp)
 }
 
 #endif /* MAC */
+
+#ifdef FAST_CONTEXT
+
+/*
+ * model_switch_stack(void **save_sp, void *sp)
+ *
+ * Pushes the callee-saved registers (and the SSE and x87 control words) onto
+ * the current stack, saves the stack pointer to *save_sp, then pops the same
+ * from the stack at sp and returns into the context which saved it.
+ *
+ * A new context starts in model_context_start(), with the function to run in
+ * %r12 and the context to switch to when it returns in %r13.
+ */
+asm(
+"	.text\n"
+"	.globl	model_switch_stack\n"
+"	.hidden	model_switch_stack\n"
+"	.type	model_switch_stack, @function\n"
+"model_switch_stack:\n"
+"	pushq	%rbp\n"
+"	pushq	%rbx\n"
+"	pushq	%r12\n"
+"	pushq	%r13\n"
+"	pushq	%r14\n"
+"	pushq	%r15\n"
+"	subq	$8, %rsp\n"
+"	stmxcsr	(%rsp)\n"
+"	fnstcw	4(%rsp)\n"
+"	movq	%rsp, (%rdi)\n"
+"	movq	%rsi, %rsp\n"
+"	ldmxcsr	(%rsp)\n"
+"	fldcw	4(%rsp)\n"
+"	addq	$8, %rsp\n"
+"	popq	%r15\n"
+"	popq	%r14\n"
+"	popq	%r13\n"
+"	popq	%r12\n"
+"	popq	%rbx\n"
+"	popq	%rbp\n"
+"	ret\n"
+"	.size	model_switch_stack, .-model_switch_stack\n"
+"\n"
+"	.globl	model_context_start\n"
+"	.hidden	model_context_start\n"
+"	.type	model_context_start, @function\n"
+"model_context_start:\n"
+"	.cfi_startproc\n"
+"	.cfi_undefined rip\n"
+"	movq	%r12, %rdi\n"
+"	movq	%r13, %rsi\n"
+"	call	model_context_run\n"
+"	ud2\n"
+"	.cfi_endproc\n"
+"	.size	model_context_start, .-model_context_start\n"
+);
+
+extern "C" void model_context_start() __attribute__((visibility("hidden")));
+
+/**
+ * @brief Run the function of a new context, then switch to its successor
+ * @param func The function
+ * @param link The context to switch to when the function returns
+ */
+extern "C" __attribute__((visibility("hidden")))
+void model_context_run(void (*func)(), model_context_t *link)
+{
+	func();
+
+	model_context_t finished;
+	model_switchcontext(&finished, link);
+}
+
+/**
+ * @brief Create a new context, with a given stack and entry function
+ * @param ucp The context structure to fill
+ * @param stack The stack to run the new context in
+ * @param stacksize The size of the stack
+ * @param func The entry point function for the context
+ * @param link The context to switch to when func returns
+ * @return 0 on success
+ */
+int model_makecontext(model_context_t *ucp, void *stack, size_t stacksize,
+		void (*func)(), model_context_t *link)
+{
+	/* 16-byte aligned, as the stack must be at a call */
+	uintptr_t top = ((uintptr_t)stack + stacksize) & ~(uintptr_t)15;
+	uint64_t *frame = (uint64_t *)(top - 8 * sizeof(uint64_t));
+
+	/* Laid out as model_switch_stack() leaves a context; the new context
+	 * inherits the current SSE and x87 control words */
+	uint32_t mxcsr;
+	uint16_t fpucw;
+	asm volatile("stmxcsr %0" : "=m" (mxcsr));
+	asm volatile("fnstcw %0" : "=m" (fpucw));
+	frame[0] = mxcsr | ((uint64_t)fpucw << 32);
+	frame[1] = 0;				/* %r15 */
+	frame[2] = 0;				/* %r14 */
+	frame[3] = (uintptr_t)link;		/* %r13 */
+	frame[4] = (uintptr_t)func;		/* %r12 */
+	frame[5] = 0;				/* %rbx */
+	frame[6] = 0;				/* %rbp */
+	frame[7] = (uintptr_t)model_context_start;	/* return address */
+
+	ucp->sp = frame;
+	return 0;
+}
+
+#else /* !FAST_CONTEXT */
+
+/**
+ * @brief Create a new context, with a given stack and entry function
+ * @param ucp The context structure to fill
+ * @param stack The stack to run the new context in
+ * @param stacksize The size of the stack
+ * @param func The entry point function for the context
+ * @param link The context to switch to when func returns
+ * @return 0 on success; otherwise, non-zero error condition
+ */
+int model_makecontext(model_context_t *ucp, void *stack, size_t stacksize,
+		void (*func)(), model_context_t *link)
+{
+	int ret = getcontext(ucp);
+	if (ret)
+		return ret;
+	ucp->uc_stack.ss_sp = stack;
+	ucp->uc_stack.ss_size = stacksize;
+	ucp->uc_stack.ss_flags = 0;
+	ucp->uc_link = link;
+	makecontext(ucp, func, 0);
+	return 0;
+}
+
+#endif /* !FAST_CONTEXT */
@@ -1,13 +1,21 @@
 /**
  * @file context.h
- * @brief ucontext header, since Mac OSX swapcontext() is broken
+ * @brief ucontext header, since Mac OSX swapcontext() is broken; and the
+ * context switch between the model checker and the user threads
  */
 
 #ifndef __CONTEXT_H__
 #define __CONTEXT_H__
 
+#include <stddef.h>
 #include <ucontext.h>
 
+#include "config.h"
+
+#if USE_FAST_CONTEXT && defined(__x86_64__) && !defined(MAC)
+#define FAST_CONTEXT
+#endif
+
 #ifdef MAC
 
 int model_swapcontext(ucontext_t *oucp, ucontext_t *ucp);
@@ -21,4 +29,70 @@ static inline int model_swapcontext(ucontext_t *oucp, ucontext_t *ucp)
 
 #endif /* !MAC */
 
+#ifdef FAST_CONTEXT
+
+/**
+ * @brief A suspended thread context
+ *
+ * The callee-saved registers of a suspended context are pushed onto its own
+ * stack, so only its stack pointer is recorded here.
+ */
+typedef struct {
+	void *sp;
+} model_context_t;
+
+extern "C" void model_switch_stack(void **save_sp, void *sp) __attribute__((visibility("hidden")));
+
+/**
+ * @brief Switch to another thread context
+ *
+ * Unlike swapcontext(), this saves only the registers which the calling
+ * convention requires a function call to preserve, and leaves the signal
+ * mask alone, so it needs no system calls.
+ *
+ * @param oucp Returns the current context
+ * @param ucp The context to switch to
+ * @return 0, once we are switched back to
+ */
+static inline int model_switchcontext(model_context_t *oucp, model_context_t *ucp)
+{
+	model_switch_stack(&oucp->sp, ucp->sp);
+	return 0;
+}
+
+/** @return The stack pointer of a suspended context */
+static inline void * model_context_sp(const model_context_t *ucp)
+{
+	return ucp->sp;
+}
+
+#else /* !FAST_CONTEXT */
+
+typedef ucontext_t model_context_t;
+
+static inline int model_switchcontext(model_context_t *oucp, model_context_t *ucp)
+{
+	return model_swapcontext(oucp, ucp);
+}
+
+/**
+ * @return The stack pointer of a suspended context, or NULL if we don't know
+ * how to find it on this platform
+ */
+static inline void * model_context_sp(const model_context_t *ucp)
+{
+#if defined(__x86_64__) && !defined(MAC)
+	return (void *)ucp->uc_mcontext.gregs[REG_RSP];
+#elif defined(__i386__) && !defined(MAC)
+	return (void *)ucp->uc_mcontext.gregs[REG_ESP];
+#else
+	return NULL;
+#endif
+}
+
+#endif /* !FAST_CONTEXT */
+
+int model_makecontext(model_context_t *ucp, void *stack, size_t stacksize,
+		void (*func)(), model_context_t *link);
+
 #endif /* __CONTEXT_H__ */
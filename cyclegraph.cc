@@ -1,13 +1,38 @@
+#include <algorithm>
+#include <limits.h>
+#include <new>
+#include <string.h>
+
 #include "cyclegraph.h"
 #include "action.h"
 #include "common.h"
 #include "promise.h"
 #include "threads-model.h"
+#include "profile.h"
+
+/**
+ * @brief A contiguous block of CycleNodes, all for the same location
+ *
+ * The nodes are stored directly after this header.
+ */
+struct cycle_node_block {
+	unsigned int used;
+	unsigned int capacity;
+};
 
 /** Initializes a CycleGraph object. */
 CycleGraph::CycleGraph() :
 	discovered(new HashTable<const CycleNode *, const CycleNode *, uintptr_t, 4, model_malloc, model_calloc, model_free>(16)),
 	queue(new ModelVector<const CycleNode *>()),
+	forward_nodes(new ModelVector<CycleNode *>()),
+	backward_nodes(new ModelVector<CycleNode *>()),
+	free_ranks(new ModelVector<unsigned int>()),
+	nextRank(0),
+	speculating(false),
+	specEdges(new ModelVector<struct cycle_edge>()),
+	specReach(new ModelVector<char>()),
+	specCounts(new ModelVector<unsigned int>()),
+	specWork(new ModelVector<unsigned int>()),
 	hasCycles(false),
 	oldCycles(false)
 {
@@ -16,10 +41,53 @@ CycleGraph::CycleGraph() :
 /** CycleGraph destructor */
 CycleGraph::~CycleGraph()
 {
+	delete specWork;
+	delete specCounts;
+	delete specReach;
+	delete specEdges;
+	delete free_ranks;
+	delete backward_nodes;
+	delete forward_nodes;
 	delete queue;
 	delete discovered;
 }
 
+/**
+ * @brief Give a new node a rank, ordering it after all existing nodes
+ * @param node The new CycleNode
+ */
+void CycleGraph::rankNode(CycleNode *node)
+{
+	node->setRank(nextRank++);
+}
+
+/**
+ * @brief Allocate the storage for a new CycleNode
+ *
+ * Each location's nodes are carved out of its own blocks, which grow in size
+ * (up to CYCLENODE_MAX_BLOCK nodes) as the location gathers more writes.
+ * Nodes are never freed individually; like the rest of the graph, they are
+ * reclaimed by rolling back the snapshotting heap.
+ *
+ * @param location The location written by the node's action(s)
+ * @return Storage for a CycleNode
+ */
+void * CycleGraph::allocNode(const void *location)
+{
+	struct cycle_node_block *block = nodeBlocks.get(location);
+	if (!block || block->used == block->capacity) {
+		unsigned int capacity = block ? block->capacity * 2 : 1;
+		if (capacity > CYCLENODE_MAX_BLOCK)
+			capacity = CYCLENODE_MAX_BLOCK;
+		block = (struct cycle_node_block *)snapshot_malloc(sizeof(*block) + capacity * sizeof(CycleNode));
+		block->used = 0;
+		block->capacity = capacity;
+		nodeBlocks.put(location, block);
+	}
+	CycleNode *nodes = (CycleNode *)(block + 1);
+	return &nodes[block->used++];
+}
+
 /**
  * Add a CycleNode to the graph, corresponding to a store ModelAction
  * @param act The write action that should be added
@@ -88,7 +156,8 @@ CycleNode * CycleGraph::getNode(const ModelAction *action)
 {
 	CycleNode *node = getNode_noCreate(action);
 	if (node == NULL) {
-		node = new CycleNode(action);
+		node = ::new (allocNode(action->get_location())) CycleNode(action);
+		rankNode(node);
 		putNode(action, node);
 	}
 	return node;
@@ -107,7 +176,9 @@ CycleNode * CycleGraph::getNode(const Promise *promise)
 {
 	CycleNode *node = getNode_noCreate(promise);
 	if (node == NULL) {
-		node = new CycleNode(promise);
+		void *location = promise->get_reader(0)->get_location();
+		node = ::new (allocNode(location)) CycleNode(promise);
+		rankNode(node);
 		putNode(promise, node);
 	}
 	return node;
@@ -197,10 +268,13 @@ bool CycleGraph::mergeNodes(CycleNode *w_node, CycleNode *p_node)
  */
 bool CycleGraph::addNodeEdge(CycleNode *fromnode, CycleNode *tonode)
 {
+	if (speculating)
+		return speculateNodeEdge(fromnode, tonode);
+
 	if (fromnode->addEdge(tonode)) {
 		rollbackvector.push_back(fromnode);
 		if (!hasCycles)
-			hasCycles = checkReachable(tonode, fromnode);
+			hasCycles = updateRanks(fromnode, tonode);
 	} else
 		return false; /* No new edge */
 
@@ -217,7 +291,7 @@ bool CycleGraph::addNodeEdge(CycleNode *fromnode, CycleNode *tonode)
 		if (rmwnode != tonode) {
 			if (rmwnode->addEdge(tonode)) {
 				if (!hasCycles)
-					hasCycles = checkReachable(tonode, rmwnode);
+					hasCycles = updateRanks(rmwnode, tonode);
 
 				rollbackvector.push_back(rmwnode);
 			}
@@ -226,6 +300,33 @@ bool CycleGraph::addNodeEdge(CycleNode *fromnode, CycleNode *tonode)
 	return true;
 }
 
+/**
+ * @brief Record the edge(s) that addNodeEdge() would add, without adding them
+ * @param fromnode The edge comes from this CycleNode
+ * @param tonode The edge points to this CycleNode
+ * @return True, if new edge(s) would be added; otherwise false
+ */
+bool CycleGraph::speculateNodeEdge(CycleNode *fromnode, CycleNode *tonode)
+{
+	if (fromnode->hasEdge(tonode))
+		return false;
+	struct cycle_edge edge = { fromnode, tonode };
+	specEdges->push_back(edge);
+
+	/* Same RMW chain handling as addNodeEdge() */
+	CycleNode *rmwnode = fromnode->getRMW();
+	if (rmwnode) {
+		while (rmwnode != tonode && rmwnode->getRMW())
+			rmwnode = rmwnode->getRMW();
+
+		if (rmwnode != tonode && !rmwnode->hasEdge(tonode)) {
+			struct cycle_edge rmwedge = { rmwnode, tonode };
+			specEdges->push_back(rmwedge);
+		}
+	}
+	return true;
+}
+
 /**
  * @brief Add an edge between a write and the RMW which reads from it
  *
@@ -243,6 +344,7 @@ void CycleGraph::addRMWEdge(const T *from, const ModelAction *rmw)
 {
 	ASSERT(from);
 	ASSERT(rmw);
+	ASSERT(!speculating);
 
 	CycleNode *fromnode = getNode(from);
 	CycleNode *rmwnode = getNode(rmw);
@@ -266,8 +368,11 @@ void CycleGraph::addRMWEdge(const T *from, const ModelAction *rmw)
 	for (unsigned int i = 0; i < fromnode->getNumEdges(); i++) {
 		CycleNode *tonode = fromnode->getEdge(i);
 		if (tonode != rmwnode) {
-			if (rmwnode->addEdge(tonode))
+			if (rmwnode->addEdge(tonode)) {
 				rollbackvector.push_back(rmwnode);
+				if (!hasCycles)
+					hasCycles = updateRanks(rmwnode, tonode);
+			}
 		}
 	}
 
@@ -386,14 +491,114 @@ void CycleGraph::dumpGraphToFile(const char *filename) const
 }
 #endif
 
+static bool rank_less(const CycleNode *a, const CycleNode *b)
+{
+	return a->getRank() < b->getRank();
+}
+
+/**
+ * @brief Restore the topological order of the ranks after adding an edge
+ *
+ * This is the incremental topological ordering algorithm of Pearce and
+ * Kelly. If @a fromnode is already ranked before @a tonode, there is nothing
+ * to do. Otherwise, only the nodes ranked between the two can be affected:
+ * those reachable from @a tonode and those which can reach @a fromnode. The
+ * latter are moved ahead of the former, reusing the same set of ranks.
+ *
+ * Ranks are never restored on rollback, since removing edges cannot
+ * invalidate a topological order.
+ *
+ * @param fromnode The edge comes from this CycleNode
+ * @param tonode The (already added) edge points to this CycleNode
+ * @return True if the new edge closes a cycle, in which case the ranks are
+ * left alone; otherwise false
+ */
+bool CycleGraph::updateRanks(CycleNode *fromnode, CycleNode *tonode)
+{
+	unsigned int lower = tonode->getRank();
+	unsigned int upper = fromnode->getRank();
+	if (lower > upper)
+		return false;
+	if (fromnode == tonode)
+		return true;
+
+	discovered->reset();
+	forward_nodes->clear();
+	backward_nodes->clear();
+	free_ranks->clear();
+
+	/* Everything reachable from tonode, ranked before fromnode */
+	queue->clear();
+	queue->push_back(tonode);
+	discovered->put(tonode, tonode);
+	while (!queue->empty()) {
+		CycleNode *node = const_cast<CycleNode *>(queue->back());
+		queue->pop_back();
+		forward_nodes->push_back(node);
+		for (unsigned int i = 0; i < node->getNumEdges(); i++) {
+			CycleNode *next = node->getEdge(i);
+			if (next == fromnode)
+				return true;
+			if (next->getRank() < upper && !discovered->contains(next)) {
+				discovered->put(next, next);
+				queue->push_back(next);
+			}
+		}
+	}
+
+	/* Everything that can reach fromnode, ranked after tonode */
+	queue->push_back(fromnode);
+	discovered->put(fromnode, fromnode);
+	while (!queue->empty()) {
+		CycleNode *node = const_cast<CycleNode *>(queue->back());
+		queue->pop_back();
+		backward_nodes->push_back(node);
+		for (unsigned int i = 0; i < node->getNumBackEdges(); i++) {
+			CycleNode *prev = node->getBackEdge(i);
+			if (prev->getRank() > lower && !discovered->contains(prev)) {
+				discovered->put(prev, prev);
+				queue->push_back(prev);
+			}
+		}
+	}
+
+	std::sort(forward_nodes->begin(), forward_nodes->end(), rank_less);
+	std::sort(backward_nodes->begin(), backward_nodes->end(), rank_less);
+	for (unsigned int i = 0; i < backward_nodes->size(); i++)
+		free_ranks->push_back((*backward_nodes)[i]->getRank());
+	for (unsigned int i = 0; i < forward_nodes->size(); i++)
+		free_ranks->push_back((*forward_nodes)[i]->getRank());
+	std::sort(free_ranks->begin(), free_ranks->end());
+
+	unsigned int r = 0;
+	for (unsigned int i = 0; i < backward_nodes->size(); i++)
+		(*backward_nodes)[i]->setRank((*free_ranks)[r++]);
+	for (unsigned int i = 0; i < forward_nodes->size(); i++)
+		(*forward_nodes)[i]->setRank((*free_ranks)[r++]);
+	return false;
+}
+
 /**
  * Checks whether one CycleNode can reach another.
+ *
+ * While the graph is acyclic, @a from can only reach @a to if it is ranked
+ * before it, and only through nodes ranked in between.
+ *
  * @param from The CycleNode from which to begin exploration
  * @param to The CycleNode to reach
  * @return True, @a from can reach @a to; otherwise, false
  */
 bool CycleGraph::checkReachable(const CycleNode *from, const CycleNode *to) const
 {
+	ProfileScope profile(PROFILE_CHECK_REACHABLE);
+
+	if (from == to)
+		return true;
+	/* Ranks are not a topological order of a cyclic graph */
+	unsigned int bound = hasCycles ? UINT_MAX : to->getRank();
+	if (from->getRank() > bound)
+		return false;
+
 	discovered->reset();
 	queue->clear();
 	queue->push_back(from);
@@ -405,7 +610,7 @@ bool CycleGraph::checkReachable(const CycleNode *from, const CycleNode *to) cons
 			return true;
 		for (unsigned int i = 0; i < node->getNumEdges(); i++) {
 			CycleNode *next = node->getEdge(i);
-			if (!discovered->contains(next)) {
+			if (next->getRank() <= bound && !discovered->contains(next)) {
 				discovered->put(next, next);
 				queue->push_back(next);
 			}
@@ -470,6 +675,86 @@ bool CycleGraph::checkPromise(const ModelAction *fromact, Promise *promise) cons
 	return false;
 }
 
+/**
+ * @brief Begin recording edges, instead of adding them to the graph
+ *
+ * Until endSpeculation(), addEdge() only records the edges it would add. It
+ * still creates nodes for the objects involved, as they are harmless to the
+ * graph.
+ */
+void CycleGraph::startSpeculation()
+{
+	ASSERT(!speculating);
+	ASSERT(rollbackvector.empty());
+	ASSERT(rmwrollbackvector.empty());
+	speculating = true;
+}
+
+/**
+ * @brief Stop recording edges, and check the recorded ones
+ * @return True, if adding the recorded edges would have created a cycle;
+ * otherwise false
+ */
+bool CycleGraph::endSpeculation()
+{
+	ASSERT(speculating);
+	speculating = false;
+	bool cycle = speculativeEdgesCycle();
+	specEdges->clear();
+	return cycle;
+}
+
+/**
+ * @brief Check whether the recorded edges would close a cycle
+ *
+ * Any new cycle would run through one or more of the recorded edges, joined
+ * up by paths already in the graph. So we consider a small graph whose
+ * vertices are the recorded edges, with a link from edge k to edge m whenever
+ * the graph has a path from k's head to m's tail, and check that for cycles
+ * (using Kahn's algorithm). Edges often share a head, which then only needs
+ * to be searched from once.
+ *
+ * @return True, if adding the recorded edges would create a cycle
+ */
+bool CycleGraph::speculativeEdgesCycle() const
+{
+	unsigned int n = specEdges->size();
+	specReach->assign(n * n, 0);
+	specCounts->assign(n, 0);
+	specWork->clear();
+
+	for (unsigned int k = 0; k < n; k++) {
+		const CycleNode *head = (*specEdges)[k].to;
+		unsigned int same = 0;
+		while (same < k && (*specEdges)[same].to != head)
+			same++;
+		for (unsigned int m = 0; m < n; m++) {
+			char reach;
+			if (same < k)
+				reach = (*specReach)[same * n + m];
+			else
+				reach = checkReachable(head, (*specEdges)[m].from);
+			(*specReach)[k * n + m] = reach;
+			if (reach)
+				(*specCounts)[m]++;
+		}
+	}
+
+	for (unsigned int k = 0; k < n; k++)
+		if ((*specCounts)[k] == 0)
+			specWork->push_back(k);
+	unsigned int ordered = 0;
+	while (!specWork->empty()) {
+		unsigned int k = specWork->back();
+		specWork->pop_back();
+		ordered++;
+		for (unsigned int m = 0; m < n; m++)
+			if ((*specReach)[k * n + m] && --(*specCounts)[m] == 0)
+				specWork->push_back(m);
+	}
+	return ordered < n;
+}
+
 /** @brief Begin a new sequence of graph additions which can be rolled back */
 void CycleGraph::startChanges()
 {
@@ -513,7 +798,8 @@ bool CycleGraph::checkForCycles() const
 CycleNode::CycleNode(const ModelAction *act) :
 	action(act),
 	promise(NULL),
-	hasRMW(NULL)
+	hasRMW(NULL),
+	rank(0)
 {
 }
 
@@ -524,7 +810,8 @@ CycleNode::CycleNode(const ModelAction *act) :
 CycleNode::CycleNode(const Promise *promise) :
 	action(NULL),
 	promise(promise),
-	hasRMW(NULL)
+	hasRMW(NULL),
+	rank(0)
 {
 }
 
@@ -558,23 +845,6 @@ unsigned int CycleNode::getNumBackEdges() const
 	return back_edges.size();
 }
 
-/**
- * @brief Remove an element from a vector
- * @param v The vector
- * @param n The element to remove
- * @return True if the element was found; false otherwise
- */
-template <typename T>
-static bool vector_remove_node(SnapVector<T>& v, const T n)
-{
-	for (unsigned int i = 0; i < v.size(); i++) {
-		if (v[i] == n) {
-			v.erase(v.begin() + i);
-			return true;
-		}
-	}
-	return false;
-}
 
 /**
  * @brief Remove a (forward) edge from this CycleNode
@@ -587,7 +857,7 @@ CycleNode * CycleNode::removeEdge()
 
 	CycleNode *ret = edges.back();
 	edges.pop_back();
-	vector_remove_node(ret->back_edges, this);
+	ret->back_edges.remove(this);
 	return ret;
 }
 
@@ -602,7 +872,7 @@ CycleNode * CycleNode::removeBackEdge()
 
 	CycleNode *ret = back_edges.back();
 	back_edges.pop_back();
-	vector_remove_node(ret->edges, this);
+	ret->edges.remove(this);
 	return ret;
 }
 
@@ -613,14 +883,25 @@ CycleNode * CycleNode::removeBackEdge()
  */
 bool CycleNode::addEdge(CycleNode *node)
 {
-	for (unsigned int i = 0; i < edges.size(); i++)
-		if (edges[i] == node)
-			return false;
+	if (hasEdge(node))
+		return false;
 	edges.push_back(node);
 	node->back_edges.push_back(this);
 	return true;
 }
 
+/**
+ * @param node The node to look for
+ * @return True if this CycleNode has an edge to @a node; false otherwise
+ */
+bool CycleNode::hasEdge(const CycleNode *node) const
+{
+	for (unsigned int i = 0; i < edges.size(); i++)
+		if (edges[i] == node)
+			return true;
+	return false;
+}
+
 /** @returns the RMW CycleNode that reads from the current CycleNode */
 CycleNode * CycleNode::getRMW() const
 {
@@ -656,3 +937,45 @@ void CycleNode::resolvePromise(const ModelAction *writer)
 	promise = NULL;
 	ASSERT(!is_promise());
 }
+
+/** @brief Constructor for an empty EdgeList */
+EdgeList::EdgeList() :
+	num(0),
+	capacity(CYCLENODE_INLINE_EDGES)
+{
+}
+
+/**
+ * @brief Add an edge to the end of the list
+ * @param node The CycleNode to which the edge points
+ */
+void EdgeList::push_back(CycleNode *node)
+{
+	if (num == capacity) {
+		CycleNode **edges = (CycleNode **)snapshot_malloc(2 * capacity * sizeof(CycleNode *));
+		memcpy(edges, get_edges(), num * sizeof(CycleNode *));
+		if (is_spilled())
+			snapshot_free(spilled_edges);
+		spilled_edges = edges;
+		capacity *= 2;
+	}
+	get_edges()[num++] = node;
+}
+
+/**
+ * @brief Remove an edge from the list, keeping the others in order
+ * @param node The CycleNode to which the edge points
+ * @return True if the edge was found; false otherwise
+ */
+bool EdgeList::remove(const CycleNode *node)
+{
+	CycleNode **edges = get_edges();
+	for (unsigned int i = 0; i < num; i++) {
+		if (edges[i] == node) {
+			memmove(&edges[i], &edges[i + 1], (num - i - 1) * sizeof(CycleNode *));
+			num--;
+			return true;
+		}
+	}
+	return false;
+}
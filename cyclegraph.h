@@ -4,6 +4,21 @@
  *
  * Used to determine whether a total order exists that satisfies the ordering
  * constraints.
+ *
+ * While the graph is acyclic, every node carries a rank such that each edge
+ * leads from a lower rank to a higher one (a topological order, maintained
+ * incrementally as edges are added). A node can only reach nodes of higher
+ * rank, so most reachability queries are answered without a search, and the
+ * rest only search the nodes ranked between the two endpoints.
+ *
+ * Edges only ever connect writes to the same location, so the graph is a set
+ * of disjoint per-location subgraphs. Each location's nodes are stored
+ * together, in contiguous blocks, so that a search only touches the memory of
+ * the location it concerns.
+ *
+ * Between startSpeculation() and endSpeculation(), added edges are only
+ * recorded, not applied, so that the feasibility of a set of edges can be
+ * probed without modifying (and later restoring) the graph.
  */
 
 #ifndef __CYCLEGRAPH_H__
@@ -20,6 +35,44 @@
 class Promise;
 class CycleNode;
 class ModelAction;
+struct cycle_node_block;
+
+/** @brief An edge between two CycleNodes */
+struct cycle_edge {
+	CycleNode *from;
+	CycleNode *to;
+};
+
+/**
+ * @brief A list of edges to CycleNodes, the first few of which are stored
+ * inline
+ */
+class EdgeList {
+ public:
+	EdgeList();
+	unsigned int size() const { return num; }
+	bool empty() const { return num == 0; }
+	CycleNode * operator[](unsigned int i) const { return get_edges()[i]; }
+	CycleNode * back() const { return get_edges()[num - 1]; }
+	void push_back(CycleNode *node);
+	void pop_back() { num--; }
+	bool remove(const CycleNode *node);
+
+	SNAPSHOTALLOC
+ private:
+	bool is_spilled() const { return capacity > CYCLENODE_INLINE_EDGES; }
+	CycleNode * const * get_edges() const { return is_spilled() ? spilled_edges : inline_edges; }
+	CycleNode ** get_edges() { return is_spilled() ? spilled_edges : inline_edges; }
+
+	unsigned int num;
+	unsigned int capacity;
+	union {
+		CycleNode *inline_edges[CYCLENODE_INLINE_EDGES];
+		/** @brief Separately allocated storage, once the edges no
+		 * longer fit inline */
+		CycleNode **spilled_edges;
+	};
+};
 
 /** @brief A graph of Model Actions for tracking cycles. */
 class CycleGraph {
@@ -42,6 +95,8 @@ class CycleGraph {
 	void startChanges();
 	void commitChanges();
 	void rollbackChanges();
+	void startSpeculation();
+	bool endSpeculation();
 #if SUPPORT_MOD_ORDER_DUMP
 	void dumpNodes(FILE *file) const;
 	void dumpGraphToFile(const char *filename) const;
@@ -63,16 +118,42 @@ class CycleGraph {
 	CycleNode * getNode(const Promise *promise);
 	CycleNode * getNode_noCreate(const ModelAction *act) const;
 	CycleNode * getNode_noCreate(const Promise *promise) const;
+	void * allocNode(const void *location);
 	bool mergeNodes(CycleNode *node1, CycleNode *node2);
+	void rankNode(CycleNode *node);
+	bool updateRanks(CycleNode *fromnode, CycleNode *tonode);
+	bool speculateNodeEdge(CycleNode *fromnode, CycleNode *tonode);
+	bool speculativeEdgesCycle() const;
 
 	HashTable<const CycleNode *, const CycleNode *, uintptr_t, 4, model_malloc, model_calloc, model_free> *discovered;
 	ModelVector<const CycleNode *> * queue;
 
+	/** @brief Scratch space for updateRanks(): the nodes to re-rank */
+	ModelVector<CycleNode *> * forward_nodes;
+	ModelVector<CycleNode *> * backward_nodes;
+	/** @brief Scratch space for updateRanks(): the ranks to hand out */
+	ModelVector<unsigned int> * free_ranks;
+
+	/** @brief The rank to give the next new node */
+	unsigned int nextRank;
+
+	/** @brief Are we only recording edges, rather than adding them? */
+	bool speculating;
+	/** @brief The edges recorded since startSpeculation() */
+	ModelVector<struct cycle_edge> * specEdges;
+	/** @brief Scratch space for speculativeEdgesCycle() */
+	ModelVector<char> * specReach;
+	ModelVector<unsigned int> * specCounts;
+	ModelVector<unsigned int> * specWork;
+
 
 	/** @brief A table for mapping ModelActions to CycleNodes */
 	HashTable<const ModelAction *, CycleNode *, uintptr_t, 4> actionToNode;
 	/** @brief A table for mapping Promises to CycleNodes */
 	HashTable<const Promise *, CycleNode *, uintptr_t, 4> promiseToNode;
+	/** @brief A table for mapping locations to the block in which their
+	 * next CycleNode will be stored */
+	HashTable<const void *, struct cycle_node_block *, uintptr_t, 4> nodeBlocks;
 
 #if SUPPORT_MOD_ORDER_DUMP
 	SnapVector<CycleNode *> nodeList;
@@ -98,6 +179,7 @@ class CycleNode {
 	CycleNode(const ModelAction *act);
 	CycleNode(const Promise *promise);
 	bool addEdge(CycleNode *node);
+	bool hasEdge(const CycleNode *node) const;
 	CycleNode * getEdge(unsigned int i) const;
 	unsigned int getNumEdges() const;
 	CycleNode * getBackEdge(unsigned int i) const;
@@ -112,6 +194,8 @@ class CycleNode {
 	const Promise * getPromise() const { return promise; }
 	bool is_promise() const { return !action; }
 	void resolvePromise(const ModelAction *writer);
+	unsigned int getRank() const { return rank; }
+	void setRank(unsigned int r) { rank = r; }
 
 	SNAPSHOTALLOC
  private:
@@ -123,14 +207,18 @@ class CycleNode {
 	const Promise *promise;
 
 	/** @brief The edges leading out from this node */
-	SnapVector<CycleNode *> edges;
+	EdgeList edges;
 
 	/** @brief The edges leading into this node */
-	SnapVector<CycleNode *> back_edges;
+	EdgeList back_edges;
 
 	/** Pointer to a RMW node that reads from this node, or NULL, if none
 	 * exists */
 	CycleNode *hasRMW;
+
+	/** @brief This node's position in the graph's topological order; only
+	 * meaningful while the graph is acyclic */
+	unsigned int rank;
 };
 
 #endif /* __CYCLEGRAPH_H__ */
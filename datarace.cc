@@ -11,6 +11,8 @@
 #include "stl-model.h"
 
 static struct ShadowTable *root;
+static struct ShadowCache *cache;
+static struct ShadowCacheStats *cachestats;
 static SnapVector<DataRace *> *unrealizedraces;
 static void *memory_base;
 static void *memory_top;
@@ -24,6 +26,10 @@ static const ModelExecution * get_execution()
 void initRaceDetector()
 {
 	root = (struct ShadowTable *)snapshot_calloc(sizeof(struct ShadowTable), 1);
+	/* The cache refers to snapshotted shadow tables, so it is rolled back
+	 * along with them; the stats are kept across executions */
+	cache = (struct ShadowCache *)snapshot_calloc(sizeof(struct ShadowCache), 1);
+	cachestats = (struct ShadowCacheStats *)model_calloc(sizeof(struct ShadowCacheStats), 1);
 	memory_base = snapshot_calloc(sizeof(struct ShadowBaseTable) * SHADOWBASETABLES, 1);
 	memory_top = ((char *)memory_base) + sizeof(struct ShadowBaseTable) * SHADOWBASETABLES;
 	unrealizedraces = new SnapVector<DataRace *>();
@@ -41,9 +47,11 @@ void * table_calloc(size_t size)
 }
 
 /** This function looks up the entry in the shadow table corresponding to a
- * given address.*/
-static uint64_t * lookupAddressEntry(const void *address)
+ * given address, and caches the ShadowBaseTable it lands in. */
+static uint64_t * walkShadowTable(const void *address, struct ShadowCacheEntry *entry)
 {
+	cachestats->misses++;
+
 	struct ShadowTable *currtable = root;
 #if BIT48
 	currtable = (struct ShadowTable *) currtable->array[(((uintptr_t)address) >> 32) & MASK16BIT];
@@ -56,9 +64,35 @@ static uint64_t * lookupAddressEntry(const void *address)
 	if (basetable == NULL) {
 		basetable = (struct ShadowBaseTable *)(currtable->array[(((uintptr_t)address) >> 16) & MASK16BIT] = table_calloc(sizeof(struct ShadowBaseTable)));
 	}
+	entry->key = ((uintptr_t)address) >> 16;
+	entry->table = basetable;
 	return &basetable->array[((uintptr_t)address) & MASK16BIT];
 }
 
+/** This function looks up the entry in the shadow table corresponding to a
+ * given address.*/
+static inline uint64_t * lookupAddressEntry(const void *address)
+{
+	uintptr_t key = ((uintptr_t)address) >> 16;
+	struct ShadowCacheEntry *entry = &cache->array[key & (SHADOWCACHESIZE - 1)];
+	if (entry->key != key || entry->table == NULL)
+		return walkShadowTable(address, entry);
+	cachestats->hits++;
+	return &entry->table->array[((uintptr_t)address) & MASK16BIT];
+}
+
+/**
+ * @brief Get the hit and miss counts of the shadow table lookup cache,
+ * across all executions
+ * @param hits Returns the number of lookups which hit the cache
+ * @param misses Returns the number of lookups which walked the shadow table
+ */
+void getShadowCacheStats(uint64_t *hits, uint64_t *misses)
+{
+	*hits = cachestats->hits;
+	*misses = cachestats->misses;
+}
+
 /**
  * Compares a current clock-vector/thread-ID pair with a clock/thread-ID pair
  * to check the potential for a data race.
@@ -157,7 +191,7 @@ bool checkDataRaces()
  */
 void assert_race(struct DataRace *race)
 {
-	model->assert_bug(
+	model->assert_bug(BUG_DATA_RACE,
 			"Data race detected @ address %p:\n"
 			"    Access 1: %5s in thread %2d @ clock %3u\n"
 			"    Access 2: %5s in thread %2d @ clock %3u",
@@ -207,12 +241,10 @@ void fullRaceCheckWrite(thread_id_t thread, void *location, uint64_t *shadow, Cl
 	record->writeClock = ourClock;
 }
 
-/** This function does race detection on a write. */
-void raceCheckWrite(thread_id_t thread, void *location)
+/** This function does race detection on a write to a single shadow cell. */
+static void shadowRaceCheckWrite(thread_id_t thread, void *location, uint64_t *shadow, ClockVector *currClock)
 {
-	uint64_t *shadow = lookupAddressEntry(location);
 	uint64_t shadowval = *shadow;
-	ClockVector *currClock = get_execution()->get_cv(thread);
 
 	/* Do full record */
 	if (shadowval != 0 && !ISSHORTRECORD(shadowval)) {
@@ -311,12 +343,10 @@ void fullRaceCheckRead(thread_id_t thread, const void *location, uint64_t *shado
 	record->numReads = copytoindex + 1;
 }
 
-/** This function does race detection on a read. */
-void raceCheckRead(thread_id_t thread, const void *location)
+/** This function does race detection on a read of a single shadow cell. */
+static void shadowRaceCheckRead(thread_id_t thread, const void *location, uint64_t *shadow, ClockVector *currClock)
 {
-	uint64_t *shadow = lookupAddressEntry(location);
 	uint64_t shadowval = *shadow;
-	ClockVector *currClock = get_execution()->get_cv(thread);
 
 	/* Do full record */
 	if (shadowval != 0 && !ISSHORTRECORD(shadowval)) {
@@ -357,6 +387,281 @@ void raceCheckRead(thread_id_t thread, const void *location)
 	*shadow = ENCODEOP(threadid, ourClock, id_to_int(writeThread), writeClock);
 }
 
+/**
+ * @brief Check whether a shadow cell stands for a word-sized access of
+ * exactly the given size
+ * @param shadow The shadow cell for the first byte of the word
+ * @param offset The offset of the word within its (8-byte aligned) group
+ * @param size The size of the word
+ */
+static bool isShadowWord(uint64_t *shadow, unsigned int offset, unsigned int size)
+{
+	if (shadow[size - 1] != WORDFORWARD(size - 1))
+		return false;
+	/* The word must not extend any further */
+	return offset + size == WORDGROUP || shadow[size] != WORDFORWARD(size);
+}
+
+/** @brief Make a copy of a shadow record, which may be a full record */
+static uint64_t copyRecord(uint64_t shadowval)
+{
+	if (shadowval == 0 || ISSHORTRECORD(shadowval))
+		return shadowval;
+
+	struct RaceRecord *record = (struct RaceRecord *)shadowval;
+	struct RaceRecord *copy = (struct RaceRecord *)snapshot_malloc(sizeof(struct RaceRecord));
+	*copy = *record;
+	if (record->capacity > 0) {
+		copy->thread = (thread_id_t *)snapshot_malloc(sizeof(thread_id_t) * record->capacity);
+		copy->readClock = (modelclock_t *)snapshot_malloc(sizeof(modelclock_t) * record->capacity);
+		std::memcpy(copy->thread, record->thread, record->numReads * sizeof(thread_id_t));
+		std::memcpy(copy->readClock, record->readClock, record->numReads * sizeof(modelclock_t));
+	}
+	return (uint64_t)copy;
+}
+
+/** @brief Free a shadow record, if it is a full record */
+static void freeRecord(uint64_t shadowval)
+{
+	if (shadowval == 0 || ISSHORTRECORD(shadowval) || ISWORDFORWARD(shadowval))
+		return;
+
+	struct RaceRecord *record = (struct RaceRecord *)shadowval;
+	if (record->capacity > 0) {
+		snapshot_free(record->thread);
+		snapshot_free(record->readClock);
+	}
+	snapshot_free(record);
+}
+
+/**
+ * @brief Split up all of the words within a group of shadow cells into byte
+ * cells, each with its own copy of its word's record
+ * @param group The first shadow cell of an (8-byte aligned) group
+ */
+static void splitShadowWords(uint64_t *group)
+{
+	for (unsigned int i = 1; i < WORDGROUP; i++)
+		if (ISWORDFORWARD(group[i]))
+			group[i] = copyRecord(group[i - WORDFORWARDOFFSET(group[i])]);
+}
+
+/**
+ * @brief Merge the byte cells of a word into a single shadow cell
+ *
+ * The cells must all hold the same race-detection state (which is the case
+ * after a write), so that the record of the first stands for all of them.
+ */
+static void mergeShadowWord(uint64_t *shadow, unsigned int size)
+{
+	for (unsigned int i = 1; i < size; i++) {
+		freeRecord(shadow[i]);
+		shadow[i] = WORDFORWARD(i);
+	}
+}
+
+/** @return True if the byte cell for an address is part of a word */
+static bool inShadowWord(uint64_t *shadow, const void *location)
+{
+	return ISWORDFORWARD(shadow[0]) ||
+		((((uintptr_t)location) & (WORDGROUP - 1)) != WORDGROUP - 1 && shadow[1] == WORDFORWARD(1));
+}
+
+/** This function does race detection on a write. */
+void raceCheckWrite(thread_id_t thread, void *location)
+{
+	uint64_t *shadow = lookupAddressEntry(location);
+	if (inShadowWord(shadow, location))
+		splitShadowWords(shadow - (((uintptr_t)location) & (WORDGROUP - 1)));
+	shadowRaceCheckWrite(thread, location, shadow, get_execution()->get_cv(thread));
+}
+
+/**
+ * @brief Race detection on a write of several bytes
+ *
+ * A naturally-aligned write of 2, 4 or 8 bytes is tracked as a single shadow
+ * cell (a word), as long as the bytes are not accessed at any other size.
+ *
+ * @param thread The writing thread
+ * @param location The address written
+ * @param size The number of bytes written
+ */
+void raceCheckWrite(thread_id_t thread, void *location, unsigned int size)
+{
+	unsigned int offset = ((uintptr_t)location) & (WORDGROUP - 1);
+	if (size == 1 || size > WORDGROUP || (offset & (size - 1)) != 0) {
+		for (unsigned int i = 0; i < size; i++)
+			raceCheckWrite(thread, (void *)(((uintptr_t)location) + i));
+		return;
+	}
+
+	uint64_t *shadow = lookupAddressEntry(location);
+	ClockVector *currClock = get_execution()->get_cv(thread);
+	if (isShadowWord(shadow, offset, size)) {
+		shadowRaceCheckWrite(thread, location, shadow, currClock);
+		return;
+	}
+
+	splitShadowWords(shadow - offset);
+	for (unsigned int i = 0; i < size; i++)
+		shadowRaceCheckWrite(thread, (void *)(((uintptr_t)location) + i), &shadow[i], currClock);
+	mergeShadowWord(shadow, size);
+}
+
+/** This function does race detection on a read. */
+void raceCheckRead(thread_id_t thread, const void *location)
+{
+	uint64_t *shadow = lookupAddressEntry(location);
+	if (inShadowWord(shadow, location))
+		splitShadowWords(shadow - (((uintptr_t)location) & (WORDGROUP - 1)));
+	shadowRaceCheckRead(thread, location, shadow, get_execution()->get_cv(thread));
+}
+
+/**
+ * @brief Race detection on a read of several bytes
+ *
+ * A naturally-aligned read of 2, 4 or 8 bytes is tracked as a single shadow
+ * cell (a word), as long as the bytes are not accessed at any other size.
+ *
+ * @param thread The reading thread
+ * @param location The address read
+ * @param size The number of bytes read
+ */
+void raceCheckRead(thread_id_t thread, const void *location, unsigned int size)
+{
+	unsigned int offset = ((uintptr_t)location) & (WORDGROUP - 1);
+	if (size == 1 || size > WORDGROUP || (offset & (size - 1)) != 0) {
+		for (unsigned int i = 0; i < size; i++)
+			raceCheckRead(thread, (const void *)(((uintptr_t)location) + i));
+		return;
+	}
+
+	uint64_t *shadow = lookupAddressEntry(location);
+	ClockVector *currClock = get_execution()->get_cv(thread);
+	if (isShadowWord(shadow, offset, size)) {
+		shadowRaceCheckRead(thread, location, shadow, currClock);
+		return;
+	}
+
+	splitShadowWords(shadow - offset);
+	for (unsigned int i = 0; i < size; i++)
+		shadowRaceCheckRead(thread, (const void *)(((uintptr_t)location) + i), &shadow[i], currClock);
+	/* Unlike after a write, the bytes may have different histories */
+	for (unsigned int i = 1; i < size; i++)
+		if (shadow[i] != shadow[0] || !ISSHORTRECORD(shadow[0]))
+			return;
+	mergeShadowWord(shadow, size);
+}
+
+/**
+ * @brief Split up the words which straddle either end of a range of shadow
+ * cells within one ShadowBaseTable
+ * @param shadow The shadow cell for the first byte of the range
+ * @param location The first byte of the range
+ * @param len The length of the range
+ */
+static void splitShadowRangeEnds(uint64_t *shadow, const void *location, size_t len)
+{
+	unsigned int offset = ((uintptr_t)location) & (WORDGROUP - 1);
+	if (offset != 0)
+		splitShadowWords(shadow - offset);
+	unsigned int endoffset = (((uintptr_t)location) + len) & (WORDGROUP - 1);
+	if (endoffset != 0)
+		splitShadowWords(shadow + len - endoffset);
+}
+
+/**
+ * @brief Race detection on a range of bytes within one ShadowBaseTable
+ *
+ * Runs of bytes with the same (short) record, which is the common case for a
+ * buffer last written by a single thread, are checked just once.
+ */
+static void rangeRaceCheck(thread_id_t thread, const void *location, size_t len, bool iswrite)
+{
+	uint64_t *shadow = lookupAddressEntry(location);
+	ClockVector *currClock = get_execution()->get_cv(thread);
+	splitShadowRangeEnds(shadow, location, len);
+
+	size_t i = 0;
+	while (i < len) {
+		uint64_t shadowval = shadow[i];
+		void *addr = (void *)(((uintptr_t)location) + i);
+		if (iswrite)
+			shadowRaceCheckWrite(thread, addr, &shadow[i], currClock);
+		else
+			shadowRaceCheckRead(thread, addr, &shadow[i], currClock);
+
+		/* The rest of the word (if any) follows along */
+		size_t next = i + 1;
+		while (next < len && ISWORDFORWARD(shadow[next]))
+			next++;
+		if (shadowval != 0 && !ISSHORTRECORD(shadowval)) {
+			i = next;
+			continue;
+		}
+
+		/* Apply the same update to the rest of the run */
+		uint64_t newval = shadow[i];
+		bool isshort = ISSHORTRECORD(newval);
+		for (; next < len; next++) {
+			if (ISWORDFORWARD(shadow[next]))
+				continue;
+			if (shadow[next] != shadowval || !isshort)
+				break;
+			shadow[next] = newval;
+		}
+		i = next;
+	}
+
+	if (!iswrite)
+		return;
+	/* All of the bytes now have the same record, so they make up words */
+	size_t first = (WORDGROUP - (((uintptr_t)location) & (WORDGROUP - 1))) & (WORDGROUP - 1);
+	for (i = first; i + WORDGROUP <= len; i += WORDGROUP)
+		mergeShadowWord(&shadow[i], WORDGROUP);
+}
+
+/**
+ * @brief Split a range of bytes at ShadowBaseTable boundaries, and perform
+ * race detection on each piece
+ */
+static void rangeRaceCheckTables(thread_id_t thread, const void *location, size_t len, bool iswrite)
+{
+	uintptr_t addr = (uintptr_t)location;
+	while (len > 0) {
+		size_t piece = (MASK16BIT + 1) - (addr & MASK16BIT);
+		if (piece > len)
+			piece = len;
+		rangeRaceCheck(thread, (const void *)addr, piece, iswrite);
+		addr += piece;
+		len -= piece;
+	}
+}
+
+/**
+ * @brief Race detection on a write to a range of bytes (e.g., a memcpy or
+ * memset destination)
+ * @param thread The writing thread
+ * @param location The first byte written
+ * @param len The number of bytes written
+ */
+void raceCheckWriteRange(thread_id_t thread, void *location, size_t len)
+{
+	rangeRaceCheckTables(thread, location, len, true);
+}
+
+/**
+ * @brief Race detection on a read of a range of bytes (e.g., a memcpy
+ * source)
+ * @param thread The reading thread
+ * @param location The first byte read
+ * @param len The number of bytes read
+ */
+void raceCheckReadRange(thread_id_t thread, const void *location, size_t len)
+{
+	rangeRaceCheckTables(thread, location, len, false);
+}
+
 bool haveUnrealizedRaces()
 {
 	return !unrealizedraces->empty();
@@ -7,6 +7,7 @@
 
 #include "config.h"
 #include <stdint.h>
+#include <stddef.h>
 #include "modeltypes.h"
 
 /* Forward declaration */
@@ -20,6 +21,26 @@ struct ShadowBaseTable {
 	uint64_t array[65536];
 };
 
+/** @brief An entry of the shadow table lookup cache */
+struct ShadowCacheEntry {
+	/** @brief The address bits above the ShadowBaseTable index */
+	uintptr_t key;
+	struct ShadowBaseTable *table;
+};
+
+/**
+ * @brief A direct-mapped cache of recently used ShadowBaseTables, so that
+ * repeated accesses to the same 64KB of memory skip the table walk
+ */
+struct ShadowCache {
+	struct ShadowCacheEntry array[SHADOWCACHESIZE];
+};
+
+struct ShadowCacheStats {
+	uint64_t hits;
+	uint64_t misses;
+};
+
 struct DataRace {
 	/* Clock and thread associated with first action.  This won't change in
 		 response to synchronization. */
@@ -43,10 +64,15 @@ struct DataRace {
 
 void initRaceDetector();
 void raceCheckWrite(thread_id_t thread, void *location);
+void raceCheckWrite(thread_id_t thread, void *location, unsigned int size);
 void raceCheckRead(thread_id_t thread, const void *location);
+void raceCheckRead(thread_id_t thread, const void *location, unsigned int size);
+void raceCheckWriteRange(thread_id_t thread, void *location, size_t len);
+void raceCheckReadRange(thread_id_t thread, const void *location, size_t len);
 bool checkDataRaces();
 void assert_race(struct DataRace *race);
 bool haveUnrealizedRaces();
+void getShadowCacheStats(uint64_t *hits, uint64_t *misses);
 
 /**
  * @brief A record of information for detecting data races
@@ -87,6 +113,19 @@ struct RaceRecord {
  */
 #define ENCODEOP(rdthread, rdtime, wrthread, wrtime) (0x1ULL | ((rdthread)<<1) | ((rdtime) << 9) | (((uint64_t)wrthread)<<32) | (((uint64_t)wrtime)<<40))
 
+/**
+ * Naturally-aligned accesses of 2, 4 or 8 bytes are tracked by the shadow cell
+ * of their first byte (the word); the cells of the other bytes of the word
+ * then hold a forwarding marker with their offset from the first byte. Since
+ * it is even and less than 16, a marker can be told apart from both encodings
+ * above. A word is split back into byte cells whenever its bytes are accessed
+ * at a different size.
+ */
+#define WORDGROUP 8
+#define WORDFORWARD(offset) (((uint64_t)(offset)) << 1)
+#define ISWORDFORWARD(x) ((x) != 0 && ((x) & ~0xeULL) == 0)
+#define WORDFORWARDOFFSET(x) ((x) >> 1)
+
 #define MAXTHREADID (THREADMASK-1)
 #define MAXREADVECTOR (READMASK-1)
 #define MAXWRITEVECTOR (WRITEMASK-1)
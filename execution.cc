@@ -16,6 +16,7 @@
 #include "datarace.h"
 #include "threads-model.h"
 #include "bugmessage.h"
+#include "profile.h"
 
 #define INITIAL_THREAD_ID	0
 
@@ -73,6 +74,8 @@ ModelExecution::ModelExecution(ModelChecker *m,
 	obj_map(),
 	condvar_waiters_map(),
 	obj_thrd_map(),
+	obj_wr_thrd_map(),
+	obj_last_conflicts_map(),
 	promises(),
 	futurevalues(),
 	pending_rel_seqs(),
@@ -127,6 +130,16 @@ static SnapVector<action_list_t> * get_safe_ptr_vect_action(HashTable<void *, Sn
 	return tmp;
 }
 
+/** @return The later of two actions, either of which may be NULL */
+static ModelAction * latest_action(ModelAction *a, ModelAction *b)
+{
+	if (!a)
+		return b;
+	if (!b)
+		return a;
+	return (*a < *b) ? b : a;
+}
+
 action_list_t * ModelExecution::get_actions_on_obj(void * obj, thread_id_t tid) const
 {
 	SnapVector<action_list_t> *wrv = obj_thrd_map.get(obj);
@@ -211,9 +224,9 @@ void ModelExecution::set_bad_sc_read()
 	priv->bad_sc_read = true;
 }
 
-bool ModelExecution::assert_bug(const char *msg)
+bool ModelExecution::assert_bug(enum bug_type type, const char *msg)
 {
-	priv->bugs.push_back(new bug_message(msg));
+	priv->bugs.push_back(new bug_message(type, msg));
 
 	if (isfeasibleprefix()) {
 		set_assert();
@@ -410,83 +423,104 @@ ModelAction * ModelExecution::get_last_conflict(ModelAction *act) const
 	case ATOMIC_RMW: {
 		ModelAction *ret = NULL;
 
-		/* linear search: from most recent to oldest */
-		action_list_t *list = obj_map.get(act->get_location());
-		action_list_t::reverse_iterator rit;
-		for (rit = list->rbegin(); rit != list->rend(); rit++) {
-			ModelAction *prev = *rit;
-			if (prev == act)
-				continue;
-			if (prev->could_synchronize_with(act)) {
-				ret = prev;
-				break;
-			}
+		/* See ModelAction::could_synchronize_with() */
+		if (act->is_seqcst()) {
+			if (act->could_be_write() || act->is_fence())
+				ret = get_last_of_kind(act, CONFLICT_SEQCST);
+			else
+				ret = get_last_of_kind(act, CONFLICT_SEQCST_WRITE);
 		}
+		if (act->is_release() && act->could_be_write())
+			ret = latest_action(ret, get_last_of_kind(act, CONFLICT_ACQUIRE_READ));
 
-		ModelAction *ret2 = get_last_fence_conflict(act);
-		if (!ret2)
-			return ret;
-		if (!ret)
-			return ret2;
-		if (*ret < *ret2)
-			return ret2;
-		return ret;
+		return latest_action(ret, get_last_fence_conflict(act));
 	}
 	case ATOMIC_LOCK:
 	case ATOMIC_TRYLOCK: {
-		/* linear search: from most recent to oldest */
-		action_list_t *list = obj_map.get(act->get_location());
-		action_list_t::reverse_iterator rit;
-		for (rit = list->rbegin(); rit != list->rend(); rit++) {
-			ModelAction *prev = *rit;
-			if (act->is_conflicting_lock(prev))
-				return prev;
-		}
-		break;
-	}
-	case ATOMIC_UNLOCK: {
-		/* linear search: from most recent to oldest */
-		action_list_t *list = obj_map.get(act->get_location());
-		action_list_t::reverse_iterator rit;
-		for (rit = list->rbegin(); rit != list->rend(); rit++) {
-			ModelAction *prev = *rit;
-			if (!act->same_thread(prev) && prev->is_failed_trylock())
-				return prev;
-		}
-		break;
-	}
-	case ATOMIC_WAIT: {
-		/* linear search: from most recent to oldest */
-		action_list_t *list = obj_map.get(act->get_location());
-		action_list_t::reverse_iterator rit;
-		for (rit = list->rbegin(); rit != list->rend(); rit++) {
-			ModelAction *prev = *rit;
-			if (!act->same_thread(prev) && prev->is_failed_trylock())
-				return prev;
-			if (!act->same_thread(prev) && prev->is_notify())
-				return prev;
+		/* See ModelAction::is_conflicting_lock() */
+		ModelAction *ret = get_last_of_kind(act, CONFLICT_SUCCESS_LOCK);
+		if (act->is_trylock() && act->is_success_lock()) {
+			ret = latest_action(ret, get_last_of_kind(act, CONFLICT_UNLOCK));
+			ret = latest_action(ret, get_last_of_kind(act, CONFLICT_WAIT));
 		}
-		break;
+		return ret;
 	}
-
+	case ATOMIC_UNLOCK:
+		return get_last_of_kind(act, CONFLICT_FAILED_TRYLOCK);
+	case ATOMIC_WAIT:
+		return latest_action(get_last_of_kind(act, CONFLICT_FAILED_TRYLOCK),
+				get_last_of_kind(act, CONFLICT_NOTIFY));
 	case ATOMIC_NOTIFY_ALL:
-	case ATOMIC_NOTIFY_ONE: {
-		/* linear search: from most recent to oldest */
-		action_list_t *list = obj_map.get(act->get_location());
-		action_list_t::reverse_iterator rit;
-		for (rit = list->rbegin(); rit != list->rend(); rit++) {
-			ModelAction *prev = *rit;
-			if (!act->same_thread(prev) && prev->is_wait())
-				return prev;
-		}
-		break;
-	}
+	case ATOMIC_NOTIFY_ONE:
+		return get_last_of_kind(act, CONFLICT_WAIT);
 	default:
 		break;
 	}
 	return NULL;
 }
 
+/**
+ * @brief Find the most recent action of some kind performed by another thread
+ * on the same object as a given action
+ * @param act The current action
+ * @param kind The kind of action to look for
+ * @return The most recent such action, if any; otherwise NULL
+ */
+ModelAction * ModelExecution::get_last_of_kind(const ModelAction *act, enum conflict_kind kind) const
+{
+	SnapVector<struct last_conflicts> *vec = obj_last_conflicts_map.get(act->get_location());
+	if (!vec)
+		return NULL;
+
+	ModelAction *ret = NULL;
+	int tid = id_to_int(act->get_tid());
+	for (unsigned int i = 0; i < vec->size(); i++)
+		if ((int)i != tid)
+			ret = latest_action(ret, (*vec)[i].last[kind]);
+	return ret;
+}
+
+/**
+ * @brief Record an action in the per-object summary of recent actions that
+ * get_last_conflict() searches
+ *
+ * Must be called once the action is complete (i.e., not for a RMWR, whose
+ * type and memory order are only settled by the rest of its RMW).
+ *
+ * @param location The object
+ * @param act The action
+ */
+void ModelExecution::record_last_conflicts(void *location, ModelAction *act)
+{
+	SnapVector<struct last_conflicts> *vec = obj_last_conflicts_map.get(location);
+	if (!vec) {
+		vec = new SnapVector<struct last_conflicts>();
+		obj_last_conflicts_map.put(location, vec);
+	}
+	int tid = id_to_int(act->get_tid());
+	if (tid >= (int)vec->size())
+		vec->resize(priv->next_thread_id);
+	ModelAction **last = (*vec)[tid].last;
+
+	if (act->is_seqcst()) {
+		last[CONFLICT_SEQCST] = act;
+		if (act->could_be_write() || act->is_fence())
+			last[CONFLICT_SEQCST_WRITE] = act;
+	}
+	if (act->is_acquire() && act->is_read())
+		last[CONFLICT_ACQUIRE_READ] = act;
+	if (act->is_success_lock())
+		last[CONFLICT_SUCCESS_LOCK] = act;
+	if (act->is_unlock())
+		last[CONFLICT_UNLOCK] = act;
+	if (act->is_wait())
+		last[CONFLICT_WAIT] = act;
+	if (act->is_failed_trylock())
+		last[CONFLICT_FAILED_TRYLOCK] = act;
+	if (act->is_notify())
+		last[CONFLICT_NOTIFY] = act;
+}
+
 /** This method finds backtracking points where we should try to
  * reorder the parameter ModelAction against.
  *
@@ -512,61 +546,101 @@ void ModelExecution::set_backtracking(ModelAction *act)
 	}
 
 	for (int i = low_tid; i < high_tid; i++) {
-		thread_id_t tid = int_to_id(i);
-
 		/* Make sure this thread can be enabled here. */
 		if (i >= node->get_num_threads())
 			break;
+		add_backtrack(node, int_to_id(i), prev, act);
+	}
+}
 
-		/* See Dynamic Partial Order Reduction (addendum), POPL '05 */
-		/* Don't backtrack into a point where the thread is disabled or sleeping. */
-		if (node->enabled_status(tid) != THREAD_ENABLED)
-			continue;
+/**
+ * @brief Mark a thread for backtracking at a Node, if it may run there
+ *
+ * @param node The Node before the conflicting action prev
+ * @param tid The thread which should run instead of prev's
+ * @param prev The earlier of the conflicting actions
+ * @param act The later of the conflicting actions
+ * @return True if the thread is now marked for backtracking (whether or not it
+ * already was, or it was left for later in a bounded search); false if it
+ * can't run at the Node, or has run there already
+ */
+bool ModelExecution::add_backtrack(Node *node, thread_id_t tid, ModelAction *prev, ModelAction *act)
+{
+	/* See Dynamic Partial Order Reduction (addendum), POPL '05 */
+	/* Don't backtrack into a point where the thread is disabled or sleeping. */
+	if (node->enabled_status(tid) != THREAD_ENABLED)
+		return false;
 
-		/* Check if this has been explored already */
-		if (node->has_been_explored(tid))
-			continue;
+	/* Check if this has been explored already */
+	if (node->has_been_explored(tid))
+		return false;
 
-		/* See if fairness allows */
-		if (params->fairwindow != 0 && !node->has_priority(tid)) {
-			bool unfair = false;
-			for (int t = 0; t < node->get_num_threads(); t++) {
-				thread_id_t tother = int_to_id(t);
-				if (node->is_enabled(tother) && node->has_priority(tother)) {
-					unfair = true;
-					break;
-				}
-			}
-			if (unfair)
-				continue;
+	/* See if fairness allows */
+	if (params->fairwindow != 0 && !node->has_priority(tid)) {
+		for (int t = 0; t < node->get_num_threads(); t++) {
+			thread_id_t tother = int_to_id(t);
+			if (node->is_enabled(tother) && node->has_priority(tother))
+				return false;
 		}
+	}
 
-		/* See if CHESS-like yield fairness allows */
-		if (params->yieldon) {
-			bool unfair = false;
-			for (int t = 0; t < node->get_num_threads(); t++) {
-				thread_id_t tother = int_to_id(t);
-				if (node->is_enabled(tother) && node->has_priority_over(tid, tother)) {
-					unfair = true;
-					break;
-				}
-			}
-			if (unfair)
-				continue;
+	/* See if CHESS-like yield fairness allows */
+	if (params->yieldon) {
+		for (int t = 0; t < node->get_num_threads(); t++) {
+			thread_id_t tother = int_to_id(t);
+			if (node->is_enabled(tother) && node->has_priority_over(tid, tother))
+				return false;
 		}
+	}
+
+	/* Leave it for later, in a bounded search */
+	if (model->defer_backtrack(node, tid)) {
+		if (model->is_beyond_bound(node, tid))
+			add_conservative_backtrack(node, tid, act);
+		return true;
+	}
+
+	/* Cache the latest backtracking point */
+	set_latest_backtrack(prev);
 
-		/* Cache the latest backtracking point */
-		set_latest_backtrack(prev);
+	/* If this is a new backtracking point, mark the tree */
+	if (!node->set_backtrack(tid))
+		return true;
+	DEBUG("Setting backtrack: conflict = %d, instead tid = %d\n",
+				id_to_int(prev->get_tid()),
+				id_to_int(act->get_tid()));
+	if (DBG_ENABLED()) {
+		prev->print();
+		act->print();
+	}
+	return true;
+}
 
-		/* If this is a new backtracking point, mark the tree */
-		if (!node->set_backtrack(tid))
+/**
+ * @brief Run a thread earlier instead, where the bound allows it
+ *
+ * When a bounded search leaves a backtracking point out for being beyond the
+ * bound, it would lose the executions in which the thread runs first, even
+ * those which are within the bound. So we also backtrack to the thread at the
+ * closest ancestor where the bound allows it (see Bounded Partial-Order
+ * Reduction, OOPSLA '13).
+ *
+ * @param node The Node at which the bound ruled out running the thread
+ * @param tid The thread
+ * @param act The later of the conflicting actions
+ */
+void ModelExecution::add_conservative_backtrack(Node *node, thread_id_t tid, ModelAction *act)
+{
+	Node *child = node;
+	for (Node *parent = node->get_parent(); parent; child = parent, parent = parent->get_parent()) {
+		if (id_to_int(tid) >= parent->get_num_threads() || parent->has_been_explored(tid))
+			return;
+		/* The scheduler has no say after some actions */
+		if (action_select_next_thread(parent->get_action()))
 			continue;
-		DEBUG("Setting backtrack: conflict = %d, instead tid = %d\n",
-					id_to_int(prev->get_tid()),
-					id_to_int(t->get_id()));
-		if (DBG_ENABLED()) {
-			prev->print();
-			act->print();
+		if (parent->enabled_status(tid) == THREAD_ENABLED && !model->is_beyond_bound(parent, tid)) {
+			add_backtrack(parent, tid, child->get_action(), act);
+			return;
 		}
 	}
 }
@@ -584,6 +658,9 @@ void ModelExecution::set_backtracking(ModelAction *act)
  */
 bool ModelExecution::set_latest_backtrack(ModelAction *act)
 {
+	/* Leave subtrees claimed by other parallel workers alone */
+	if (model->is_pruned_backtrack(act))
+		return false;
 	if (!priv->next_backtrack || *act > *priv->next_backtrack) {
 		priv->next_backtrack = act;
 		return true;
@@ -603,6 +680,23 @@ ModelAction * ModelExecution::get_next_backtrack()
 	return next;
 }
 
+/**
+ * @brief Find the latest backtracking point from scratch
+ *
+ * Used when the exploration state of the NodeStack has changed since the
+ * actions were executed (i.e., it was restored from a checkpoint, or we rolled
+ * back to a mid-execution snapshot).
+ */
+void ModelExecution::recompute_backtracking()
+{
+	priv->next_backtrack = NULL;
+	for (action_list_t::iterator it = action_trace.begin(); it != action_trace.end(); it++) {
+		ModelAction *act = *it;
+		if (!act->is_uninitialized() && act->get_node())
+			check_curr_backtracking(act);
+	}
+}
+
 /**
  * Processes a read model action.
  * @param curr is the read model action to process.
@@ -704,7 +798,7 @@ bool ModelExecution::process_mutex(ModelAction *curr)
 		//otherwise fall into the lock case
 	case ATOMIC_LOCK: {
 		if (curr->get_cv()->getClock(state->alloc_tid) <= state->alloc_clock)
-			assert_bug("Lock access before initialization");
+			assert_bug(BUG_UNINIT_LOCK, "Lock access before initialization");
 		state->locked = get_thread(curr);
 		ModelAction *unlock = get_last_unlock(curr);
 		//synchronize with the previous unlock statement
@@ -751,7 +845,7 @@ bool ModelExecution::process_mutex(ModelAction *curr)
 		action_list_t *waiters = get_safe_ptr_action(&condvar_waiters_map, curr->get_location());
 		int wakeupthread = curr->get_node()->get_misc();
 		action_list_t::iterator it = waiters->begin();
-		advance(it, wakeupthread);
+		std::advance(it, wakeupthread);
 		scheduler->wake(get_thread(*it));
 		waiters->erase(it);
 		break;
@@ -820,7 +914,7 @@ void ModelExecution::add_future_value(const ModelAction *writer, ModelAction *re
 		writer->get_seq_number() + params->maxfuturedelay,
 		write_thread->get_id(),
 	};
-	if (node->add_future_value(fv))
+	if (node->add_future_value(fv) && !model->defer_future_value(node, &fv))
 		set_latest_backtrack(reader);
 }
 
@@ -1078,7 +1172,7 @@ bool ModelExecution::initialize_curr_action(ModelAction **curr)
 
 	(*curr)->set_seq_number(get_next_seq_num());
 
-	newcurr = node_stack->explore_action(*curr, scheduler->get_enabled_array());
+	newcurr = node_stack->explore_action(*curr, scheduler->get_enabled_array(), scheduler->get_scheduler_thread());
 	if (newcurr) {
 		/* First restore type and order in case of RMW operation */
 		if ((*curr)->is_rmwr())
@@ -1244,6 +1338,7 @@ bool ModelExecution::check_action_enabled(ModelAction *curr) {
  */
 ModelAction * ModelExecution::check_current_action(ModelAction *curr)
 {
+	ProfileScope profile(PROFILE_CHECK_CURRENT_ACTION);
 	ASSERT(curr);
 	bool second_part_of_rmw = curr->is_rmwc() || curr->is_rmw();
 	bool newly_explored = initialize_curr_action(&curr);
@@ -1344,6 +1439,12 @@ ModelAction * ModelExecution::check_current_action(ModelAction *curr)
 
 	check_curr_backtracking(curr);
 	set_backtracking(curr);
+	if (!curr->is_rmwr()) {
+		record_last_conflicts(curr->get_location(), curr);
+		/* A wait also appears among the actions on its mutex */
+		if (curr->is_wait())
+			record_last_conflicts((void *)curr->get_value(), curr);
+	}
 	return curr;
 }
 
@@ -1442,6 +1543,7 @@ ModelAction * ModelExecution::process_rmw(ModelAction *act) {
 	ModelAction *lastread = get_last_action(act->get_tid());
 	lastread->process_rmw(act);
 	if (act->is_rmw()) {
+		add_write_to_lists(lastread);
 		if (lastread->get_reads_from())
 			mo_graph->addRMWEdge(lastread->get_reads_from(), lastread);
 		else
@@ -1573,6 +1675,7 @@ bool ModelExecution::check_recency(ModelAction *curr, const T *rf) const
 template <typename rf_type>
 bool ModelExecution::r_modification_order(ModelAction *curr, const rf_type *rf)
 {
+	ProfileScope profile(PROFILE_R_MODIFICATION_ORDER);
 	SnapVector<action_list_t> *thrd_lists = obj_thrd_map.get(curr->get_location());
 	unsigned int i;
 	bool added = false;
@@ -1696,6 +1799,7 @@ bool ModelExecution::r_modification_order(ModelAction *curr, const rf_type *rf)
  */
 bool ModelExecution::w_modification_order(ModelAction *curr, ModelVector<ModelAction *> *send_fv)
 {
+	ProfileScope profile(PROFILE_W_MODIFICATION_ORDER);
 	SnapVector<action_list_t> *thrd_lists = obj_thrd_map.get(curr->get_location());
 	unsigned int i;
 	bool added = false;
@@ -1942,6 +2046,8 @@ bool ModelExecution::release_seq_heads(const ModelAction *rf,
 		rel_heads_list_t *release_heads,
 		struct release_seq *pending) const
 {
+	ProfileScope profile(PROFILE_RELEASE_SEQ_HEADS);
+
 	/* Only check for release sequences if there are no cycles */
 	if (mo_graph->checkForCycles())
 		return false;
@@ -2232,6 +2338,15 @@ void ModelExecution::add_action_to_lists(ModelAction *act)
 	if (uninit)
 		(*vec)[uninit_id].push_front(uninit);
 
+	if (act->is_write())
+		add_write_to_lists(act);
+	if (uninit) {
+		SnapVector<action_list_t> *wrvec = get_safe_ptr_vect_action(&obj_wr_thrd_map, act->get_location());
+		if (uninit_id >= (int)wrvec->size())
+			wrvec->resize(priv->next_thread_id);
+		(*wrvec)[uninit_id].push_front(uninit);
+	}
+
 	if ((int)thrd_last_action.size() <= tid)
 		thrd_last_action.resize(get_num_threads());
 	thrd_last_action[tid] = act;
@@ -2255,6 +2370,23 @@ void ModelExecution::add_action_to_lists(ModelAction *act)
 	}
 }
 
+/**
+ * @brief Add a write to the per-object, per-thread lists of writes
+ *
+ * Writes must be added in program order; an RMW is added once its RMWR is
+ * closed out (see ModelExecution::process_rmw).
+ *
+ * @param write The write action
+ */
+void ModelExecution::add_write_to_lists(ModelAction *write)
+{
+	int tid = id_to_int(write->get_tid());
+	SnapVector<action_list_t> *vec = get_safe_ptr_vect_action(&obj_wr_thrd_map, write->get_location());
+	if (tid >= (int)vec->size())
+		vec->resize(priv->next_thread_id);
+	(*vec)[tid].push_back(write);
+}
+
 /**
  * @brief Get the last action performed by a particular Thread
  * @param tid The thread ID of the Thread in question
@@ -2609,7 +2741,9 @@ void ModelExecution::compute_relseq_breakwrites(ModelAction *curr)
  */
 void ModelExecution::build_may_read_from(ModelAction *curr)
 {
-	SnapVector<action_list_t> *thrd_lists = obj_thrd_map.get(curr->get_location());
+	ProfileScope profile(PROFILE_BUILD_MAY_READ_FROM);
+	SnapVector<action_list_t> *thrd_lists = obj_wr_thrd_map.get(curr->get_location());
+	unsigned int num_lists = thrd_lists ? thrd_lists->size() : 0;
 	unsigned int i;
 	ASSERT(curr->is_read());
 
@@ -2618,16 +2752,27 @@ void ModelExecution::build_may_read_from(ModelAction *curr)
 	if (curr->is_seqcst())
 		last_sc_write = get_last_seq_cst_write(curr);
 
+	/* The most recent write in each thread that "happens before" curr */
+	ModelVector<ModelAction *> hb_writes(num_lists, NULL);
+	for (i = 0; i < num_lists; i++) {
+		action_list_t *list = &(*thrd_lists)[i];
+		action_list_t::reverse_iterator rit;
+		for (rit = list->rbegin(); rit != list->rend(); rit++)
+			if ((*rit)->happens_before(curr)) {
+				hb_writes[i] = *rit;
+				break;
+			}
+	}
+
 	/* Iterate over all threads */
-	for (i = 0; i < thrd_lists->size(); i++) {
-		/* Iterate over actions in thread, starting from most recent */
+	for (i = 0; i < num_lists; i++) {
+		/* Iterate over writes in thread, starting from most recent */
 		action_list_t *list = &(*thrd_lists)[i];
 		action_list_t::reverse_iterator rit;
 		for (rit = list->rbegin(); rit != list->rend(); rit++) {
 			ModelAction *act = *rit;
 
-			/* Only consider 'write' actions */
-			if (!act->is_write() || act == curr)
+			if (act == curr)
 				continue;
 
 			/* Don't consider more than one seq_cst write if we are a seq_cst read. */
@@ -2637,18 +2782,19 @@ void ModelExecution::build_may_read_from(ModelAction *curr)
 				allow_read = false;
 			else if (curr->get_sleep_flag() && !curr->is_seqcst() && !sleep_can_read_from(curr, act))
 				allow_read = false;
+			else if (mo_before_hb_write(act, &hb_writes))
+				allow_read = false;
 
 			if (allow_read) {
 				/* Only add feasible reads */
-				mo_graph->startChanges();
+				mo_graph->startSpeculation();
 				r_modification_order(curr, act);
-				if (!is_infeasible())
+				if (!mo_graph->endSpeculation() && !is_infeasible())
 					curr->get_node()->add_read_from_past(act);
-				mo_graph->rollbackChanges();
 			}
 
 			/* Include at most one act per-thread that "happens before" curr */
-			if (act->happens_before(curr))
+			if (act == hb_writes[i])
 				break;
 		}
 	}
@@ -2659,11 +2805,10 @@ void ModelExecution::build_may_read_from(ModelAction *curr)
 		const ModelAction *promise_read = promise->get_reader(0);
 		if (promise_read->same_var(curr)) {
 			/* Only add feasible future-values */
-			mo_graph->startChanges();
+			mo_graph->startSpeculation();
 			r_modification_order(curr, promise);
-			if (!is_infeasible())
+			if (!mo_graph->endSpeculation() && !is_infeasible())
 				curr->get_node()->add_read_from_promise(promise_read);
-			mo_graph->rollbackChanges();
 		}
 	}
 
@@ -2682,6 +2827,28 @@ void ModelExecution::build_may_read_from(ModelAction *curr)
 	}
 }
 
+/**
+ * @brief Check if a write is already known to be modification-ordered before
+ * a write that "happens before" the current read
+ *
+ * By read-write coherence, the read can't read from such a write, so there
+ * is no need to try it out with r_modification_order().
+ *
+ * @param write The write to check
+ * @param hb_writes The most recent write in each thread that happens before
+ * the read (or NULL)
+ * @return True if the read can't read from the write
+ */
+bool ModelExecution::mo_before_hb_write(const ModelAction *write, const ModelVector<ModelAction *> *hb_writes) const
+{
+	for (unsigned int i = 0; i < hb_writes->size(); i++) {
+		const ModelAction *hb_write = (*hb_writes)[i];
+		if (hb_write && hb_write != write && mo_graph->checkReachable(write, hb_write))
+			return true;
+	}
+	return false;
+}
+
 bool ModelExecution::sleep_can_read_from(ModelAction *curr, const ModelAction *write)
 {
 	for ( ; write != NULL; write = write->get_reads_from()) {
@@ -2909,12 +3076,60 @@ Thread * ModelExecution::action_select_next_thread(const ModelAction *curr) cons
 	/* Do not split atomic RMW */
 	if (curr->is_rmwr())
 		return get_thread(curr);
-	/* Follow CREATE with the created thread */
-	if (curr->get_type() == THREAD_CREATE)
+	/* Follow CREATE with the created thread (which, in run-to-visible
+	 * mode, starts up by itself anyway) */
+	if (curr->get_type() == THREAD_CREATE && !params->runtovisible)
 		return curr->get_thread_operand();
 	return NULL;
 }
 
+/**
+ * @brief Check whether no other thread can observe an action
+ *
+ * Such an action never conflicts with another thread's action, so it is never
+ * a backtracking point, and its Node has no other behaviors to explore. The
+ * order in which it runs relative to the other threads thus doesn't matter,
+ * and in run-to-visible mode, the thread takes the step by itself (see
+ * take_invisible_step()).
+ *
+ * Relaxed loads are not invisible, even from a location which no other thread
+ * has touched yet: running them early would leave any later stores by other
+ * threads to the future values.
+ *
+ * @param act The pending action
+ * @return True if the action is invisible to the other threads
+ */
+bool ModelExecution::is_invisible(const ModelAction *act) const
+{
+	switch (act->get_type()) {
+	case THREAD_START:
+		return true;
+	case THREAD_YIELD:
+		/* Unless yields steer the scheduler */
+		return !params->yieldon && !params->yieldblock;
+	case ATOMIC_INIT:
+	case ATOMIC_WRITE: {
+		/* A relaxed store can't synchronize with anything. As long as
+		 * no other thread has touched its location, it can't send
+		 * future values to, or satisfy promises of, any reads either. */
+		if (!act->is_relaxed() || !promises.empty())
+			return false;
+		SnapVector<action_list_t> *thrd_lists = obj_thrd_map.get(act->get_location());
+		if (!thrd_lists)
+			return true;
+		for (unsigned int i = 0; i < thrd_lists->size(); i++) {
+			thread_id_t tid = int_to_id(i);
+			/* The model thread only holds the UNINIT action */
+			if (tid != act->get_tid() && tid != model_thread->get_id() && !(*thrd_lists)[i].empty())
+				return false;
+		}
+		return true;
+	}
+	default:
+		return false;
+	}
+}
+
 /** @return True if the execution has taken too many steps */
 bool ModelExecution::too_many_steps() const
 {
@@ -2929,6 +3144,7 @@ bool ModelExecution::too_many_steps() const
  */
 Thread * ModelExecution::take_step(ModelAction *curr)
 {
+	ProfileScope profile(PROFILE_TAKE_STEP);
 	Thread *curr_thrd = get_thread(curr);
 	ASSERT(curr_thrd->get_state() == THREAD_READY);
 
@@ -2942,6 +3158,24 @@ Thread * ModelExecution::take_step(ModelAction *curr)
 	return action_select_next_thread(curr);
 }
 
+/**
+ * @brief Take an invisible step, from the context of the thread taking it
+ *
+ * Unlike take_step(), this doesn't go through the scheduler: the thread just
+ * keeps running afterwards, as no other thread could have been scheduled in
+ * between to any effect.
+ *
+ * @param curr The step to take; must be invisible (see is_invisible())
+ */
+void ModelExecution::take_invisible_step(ModelAction *curr)
+{
+	ProfileScope profile(PROFILE_TAKE_STEP);
+	ASSERT(is_invisible(curr));
+
+	curr = check_current_action(curr);
+	ASSERT(curr && !action_select_next_thread(curr));
+}
+
 /**
  * Launch end-of-execution release sequence fixups only when
  * the execution is otherwise feasible AND there are:
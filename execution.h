@@ -10,11 +10,13 @@
 
 #include "mymemory.h"
 #include "hashtable.h"
+#include "chunklist.h"
 #include "workqueue.h"
 #include "config.h"
 #include "modeltypes.h"
 #include "stl-model.h"
 #include "params.h"
+#include "bugmessage.h"
 
 /* Forward declaration */
 class Node;
@@ -26,11 +28,10 @@ class Thread;
 class ClockVector;
 struct model_snapshot_members;
 class ModelChecker;
-struct bug_message;
 
 /** @brief Shorthand for a list of release sequence heads */
 typedef ModelVector<const ModelAction *> rel_heads_list_t;
-typedef SnapList<ModelAction *> action_list_t;
+typedef ChunkList<ModelAction *> action_list_t;
 
 struct PendingFutureValue {
 	PendingFutureValue(ModelAction *writer, ModelAction *reader) :
@@ -57,6 +58,25 @@ struct release_seq {
 	SnapVector<const ModelAction *> writes;
 };
 
+/** @brief The kinds of action that get_last_conflict() looks for */
+enum conflict_kind {
+	CONFLICT_SEQCST,		/**< @brief Any seq_cst action */
+	CONFLICT_SEQCST_WRITE,		/**< @brief A seq_cst write or fence */
+	CONFLICT_ACQUIRE_READ,		/**< @brief A load-acquire */
+	CONFLICT_SUCCESS_LOCK,		/**< @brief A lock or successful trylock */
+	CONFLICT_UNLOCK,		/**< @brief An unlock */
+	CONFLICT_WAIT,			/**< @brief A condition variable wait */
+	CONFLICT_FAILED_TRYLOCK,	/**< @brief A failed trylock */
+	CONFLICT_NOTIFY,		/**< @brief A notify_one or notify_all */
+	NUM_CONFLICT_KINDS
+};
+
+/** @brief The most recent action of each conflict_kind performed by one
+ *  thread on one object */
+struct last_conflicts {
+	ModelAction *last[NUM_CONFLICT_KINDS];
+};
+
 /** @brief The central structure for model-checking */
 class ModelExecution {
 public:
@@ -69,6 +89,8 @@ public:
 	const struct model_params * get_params() const { return params; }
 
 	Thread * take_step(ModelAction *curr);
+	bool is_invisible(const ModelAction *act) const;
+	void take_invisible_step(ModelAction *curr);
 	void fixup_release_sequences();
 
 	void print_summary() const;
@@ -97,7 +119,7 @@ public:
 
 	bool check_action_enabled(ModelAction *curr);
 
-	bool assert_bug(const char *msg);
+	bool assert_bug(enum bug_type type, const char *msg);
 	bool have_bug_reports() const;
 	SnapVector<bug_message *> * get_bugs() const;
 
@@ -113,6 +135,7 @@ public:
 	bool too_many_steps() const;
 
 	ModelAction * get_next_backtrack();
+	void recompute_backtracking();
 
 	action_list_t * get_action_trace() { return &action_trace; }
 
@@ -134,6 +157,7 @@ private:
 	Scheduler * const scheduler;
 
 	bool sleep_can_read_from(ModelAction *curr, const ModelAction *write);
+	bool mo_before_hb_write(const ModelAction *write, const ModelVector<ModelAction *> *hb_writes) const;
 	bool thin_air_constraint_may_allow(const ModelAction *writer, const ModelAction *reader) const;
 	bool mo_may_allow(const ModelAction *writer, const ModelAction *reader);
 	bool promises_may_allow(const ModelAction *writer, const ModelAction *reader) const;
@@ -164,7 +188,11 @@ private:
 
 	ModelAction * get_last_fence_conflict(ModelAction *act) const;
 	ModelAction * get_last_conflict(ModelAction *act) const;
+	ModelAction * get_last_of_kind(const ModelAction *act, enum conflict_kind kind) const;
+	void record_last_conflicts(void *location, ModelAction *act);
 	void set_backtracking(ModelAction *act);
+	bool add_backtrack(Node *node, thread_id_t tid, ModelAction *prev, ModelAction *act);
+	void add_conservative_backtrack(Node *node, thread_id_t tid, ModelAction *act);
 	bool set_latest_backtrack(ModelAction *act);
 	Promise * pop_promise_to_resolve(const ModelAction *curr);
 	bool resolve_promise(ModelAction *curr, Promise *promise,
@@ -178,6 +206,7 @@ private:
 
 	void check_curr_backtracking(ModelAction *curr);
 	void add_action_to_lists(ModelAction *act);
+	void add_write_to_lists(ModelAction *write);
 	ModelAction * get_last_fence_release(thread_id_t tid) const;
 	ModelAction * get_last_seq_cst_write(ModelAction *curr) const;
 	ModelAction * get_last_seq_cst_fence(thread_id_t tid, const ModelAction *before_fence) const;
@@ -209,6 +238,14 @@ private:
 
 	HashTable<void *, SnapVector<action_list_t> *, uintptr_t, 4> obj_thrd_map;
 
+	/** Per-object, per-thread list of write actions. A subset of
+	 * obj_thrd_map, for enumerating the writes that a load may read from. */
+	HashTable<void *, SnapVector<action_list_t> *, uintptr_t, 4> obj_wr_thrd_map;
+
+	/** Per-object, per-thread summary of the most recent actions that
+	 * other threads' actions may conflict with (see get_last_conflict) */
+	HashTable<const void *, SnapVector<struct last_conflicts> *, uintptr_t, 4> obj_last_conflicts_map;
+
 	/**
 	 * @brief List of currently-pending promises
 	 *
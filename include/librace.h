@@ -6,6 +6,7 @@
 #define __LIBRACE_H__
 
 #include <stdint.h>
+#include <stddef.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -21,6 +22,9 @@ extern "C" {
 	uint32_t load_32(const void *addr);
 	uint64_t load_64(const void *addr);
 
+	void race_check_write_range(void *addr, size_t len);
+	void race_check_read_range(const void *addr, size_t len);
+
 #ifdef __cplusplus
 }
 #endif
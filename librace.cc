@@ -6,11 +6,13 @@
 #include "datarace.h"
 #include "model.h"
 #include "threads-model.h"
+#include "profile.h"
 
 void store_8(void *addr, uint8_t val)
 {
 	DEBUG("addr = %p, val = %" PRIu8 "\n", addr, val);
 	thread_id_t tid = thread_current()->get_id();
+	ProfileScope profile(PROFILE_RACE_CHECK);
 	raceCheckWrite(tid, addr);
 	(*(uint8_t *)addr) = val;
 }
@@ -19,8 +21,8 @@ void store_16(void *addr, uint16_t val)
 {
 	DEBUG("addr = %p, val = %" PRIu16 "\n", addr, val);
 	thread_id_t tid = thread_current()->get_id();
-	raceCheckWrite(tid, addr);
-	raceCheckWrite(tid, (void *)(((uintptr_t)addr) + 1));
+	ProfileScope profile(PROFILE_RACE_CHECK);
+	raceCheckWrite(tid, addr, 2);
 	(*(uint16_t *)addr) = val;
 }
 
@@ -28,10 +30,8 @@ void store_32(void *addr, uint32_t val)
 {
 	DEBUG("addr = %p, val = %" PRIu32 "\n", addr, val);
 	thread_id_t tid = thread_current()->get_id();
-	raceCheckWrite(tid, addr);
-	raceCheckWrite(tid, (void *)(((uintptr_t)addr) + 1));
-	raceCheckWrite(tid, (void *)(((uintptr_t)addr) + 2));
-	raceCheckWrite(tid, (void *)(((uintptr_t)addr) + 3));
+	ProfileScope profile(PROFILE_RACE_CHECK);
+	raceCheckWrite(tid, addr, 4);
 	(*(uint32_t *)addr) = val;
 }
 
@@ -39,14 +39,8 @@ void store_64(void *addr, uint64_t val)
 {
 	DEBUG("addr = %p, val = %" PRIu64 "\n", addr, val);
 	thread_id_t tid = thread_current()->get_id();
-	raceCheckWrite(tid, addr);
-	raceCheckWrite(tid, (void *)(((uintptr_t)addr) + 1));
-	raceCheckWrite(tid, (void *)(((uintptr_t)addr) + 2));
-	raceCheckWrite(tid, (void *)(((uintptr_t)addr) + 3));
-	raceCheckWrite(tid, (void *)(((uintptr_t)addr) + 4));
-	raceCheckWrite(tid, (void *)(((uintptr_t)addr) + 5));
-	raceCheckWrite(tid, (void *)(((uintptr_t)addr) + 6));
-	raceCheckWrite(tid, (void *)(((uintptr_t)addr) + 7));
+	ProfileScope profile(PROFILE_RACE_CHECK);
+	raceCheckWrite(tid, addr, 8);
 	(*(uint64_t *)addr) = val;
 }
 
@@ -54,6 +48,7 @@ uint8_t load_8(const void *addr)
 {
 	DEBUG("addr = %p\n", addr);
 	thread_id_t tid = thread_current()->get_id();
+	ProfileScope profile(PROFILE_RACE_CHECK);
 	raceCheckRead(tid, addr);
 	return *((uint8_t *)addr);
 }
@@ -62,8 +57,8 @@ uint16_t load_16(const void *addr)
 {
 	DEBUG("addr = %p\n", addr);
 	thread_id_t tid = thread_current()->get_id();
-	raceCheckRead(tid, addr);
-	raceCheckRead(tid, (const void *)(((uintptr_t)addr) + 1));
+	ProfileScope profile(PROFILE_RACE_CHECK);
+	raceCheckRead(tid, addr, 2);
 	return *((uint16_t *)addr);
 }
 
@@ -71,10 +66,8 @@ uint32_t load_32(const void *addr)
 {
 	DEBUG("addr = %p\n", addr);
 	thread_id_t tid = thread_current()->get_id();
-	raceCheckRead(tid, addr);
-	raceCheckRead(tid, (const void *)(((uintptr_t)addr) + 1));
-	raceCheckRead(tid, (const void *)(((uintptr_t)addr) + 2));
-	raceCheckRead(tid, (const void *)(((uintptr_t)addr) + 3));
+	ProfileScope profile(PROFILE_RACE_CHECK);
+	raceCheckRead(tid, addr, 4);
 	return *((uint32_t *)addr);
 }
 
@@ -82,13 +75,41 @@ uint64_t load_64(const void *addr)
 {
 	DEBUG("addr = %p\n", addr);
 	thread_id_t tid = thread_current()->get_id();
-	raceCheckRead(tid, addr);
-	raceCheckRead(tid, (const void *)(((uintptr_t)addr) + 1));
-	raceCheckRead(tid, (const void *)(((uintptr_t)addr) + 2));
-	raceCheckRead(tid, (const void *)(((uintptr_t)addr) + 3));
-	raceCheckRead(tid, (const void *)(((uintptr_t)addr) + 4));
-	raceCheckRead(tid, (const void *)(((uintptr_t)addr) + 5));
-	raceCheckRead(tid, (const void *)(((uintptr_t)addr) + 6));
-	raceCheckRead(tid, (const void *)(((uintptr_t)addr) + 7));
+	ProfileScope profile(PROFILE_RACE_CHECK);
+	raceCheckRead(tid, addr, 8);
 	return *((uint64_t *)addr);
 }
+
+/**
+ * @brief Check a write to a range of memory for data races
+ *
+ * For use with bulk writes, such as the destination of a memcpy() or
+ * memset(), in place of a store_8() per byte.
+ *
+ * @param addr The first byte written
+ * @param len The number of bytes written
+ */
+void race_check_write_range(void *addr, size_t len)
+{
+	DEBUG("addr = %p, len = %zu\n", addr, len);
+	thread_id_t tid = thread_current()->get_id();
+	ProfileScope profile(PROFILE_RACE_CHECK);
+	raceCheckWriteRange(tid, addr, len);
+}
+
+/**
+ * @brief Check a read of a range of memory for data races
+ *
+ * For use with bulk reads, such as the source of a memcpy(), in place of a
+ * load_8() per byte.
+ *
+ * @param addr The first byte read
+ * @param len The number of bytes read
+ */
+void race_check_read_range(const void *addr, size_t len)
+{
+	DEBUG("addr = %p, len = %zu\n", addr, len);
+	thread_id_t tid = thread_current()->get_id();
+	ProfileScope profile(PROFILE_RACE_CHECK);
+	raceCheckReadRange(tid, addr, len);
+}
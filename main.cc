@@ -3,8 +3,10 @@
  */
 
 #include <unistd.h>
+#include <stdlib.h>
 #include <getopt.h>
 #include <string.h>
+#include <sys/personality.h>
 
 #include "common.h"
 #include "output.h"
@@ -17,6 +19,16 @@
 #include "snapshot-interface.h"
 #include "scanalysis.h"
 #include "plugins.h"
+#include "profile.h"
+
+/** @brief Option codes for the long-only options */
+enum {
+	OPT_STATS_JSON = 256,
+	OPT_STACK_SIZE,
+	OPT_RUN_TO_VISIBLE,
+	OPT_PREEMPTION_BOUND,
+	OPT_DELAY_BOUND
+};
 
 static void param_defaults(struct model_params *params)
 {
@@ -32,6 +44,18 @@ static void param_defaults(struct model_params *params)
 	params->verbose = !!DBG_ENABLED();
 	params->uninitvalue = 0;
 	params->maxexecutions = 0;
+	params->jobs = 1;
+	params->splitdepth = 20;
+	params->checkpointfile = NULL;
+	params->checkpointinterval = 1000;
+	params->resumefile = NULL;
+	params->snapshotinterval = 64;
+	params->profile = false;
+	params->statsjsonfile = NULL;
+	params->stacksize = STACK_SIZE;
+	params->runtovisible = false;
+	params->boundtype = BOUND_NONE;
+	params->maxbound = 0;
 }
 
 static void print_usage(const char *program_name, struct model_params *params)
@@ -89,6 +113,35 @@ static void print_usage(const char *program_name, struct model_params *params)
 "-x, --maxexec=NUM           Maximum number of executions.\n"
 "                            Default: %u\n"
 "                            -o help for a list of options\n"
+"-j, --jobs=NUM              Explore in parallel using NUM worker processes.\n"
+"                              Default: %u\n"
+"-J, --splitdepth=NUM        Divide up the exploration tree between parallel\n"
+"                              workers at divergence points shallower than NUM.\n"
+"                              Default: %u\n"
+"-c, --checkpoint=FILE       Periodically save the exploration state to FILE.\n"
+"-C, --checkpoint-interval=NUM\n"
+"                            Save a checkpoint every NUM executions.\n"
+"                              Default: %u\n"
+"-r, --resume=FILE           Resume exploring from the checkpoint in FILE.\n"
+"-i, --snapshot-interval=NUM Take a snapshot every NUM steps of an execution, so\n"
+"                              that later executions can resume from it rather\n"
+"                              than replaying from the start (0 disables).\n"
+"                              Default: %u\n"
+"-P, --profile               Print a breakdown of the model checker's time and\n"
+"                              memory usage at exit.\n"
+"--stats-json=FILE           Export the run statistics to FILE, as JSON.\n"
+"--stack-size=KB             Size of the stack of each user thread, in KB.\n"
+"                              Default: %zu\n"
+"--run-to-visible            Don't stop at steps which no other thread can\n"
+"                              observe (e.g., thread start-up); the thread\n"
+"                              takes them itself and runs on to its next\n"
+"                              visible operation.\n"
+"--preemption-bound=MAX      Bounded search: explore the executions with no\n"
+"                              preemptions, then with at most 1, 2, ... up to\n"
+"                              MAX, stopping after the first bound which finds\n"
+"                              a bug.\n"
+"--delay-bound=MAX           Bounded search, counting the scheduler delays\n"
+"                              rather than the preemptions.\n"
 " --                         Program arguments follow.\n\n",
 		program_name,
 		params->maxreads,
@@ -102,7 +155,12 @@ static void print_usage(const char *program_name, struct model_params *params)
 		params->bound,
 		params->verbose,
     params->uninitvalue,
-		params->maxexecutions);
+		params->maxexecutions,
+		params->jobs,
+		params->splitdepth,
+		params->checkpointinterval,
+		params->snapshotinterval,
+		params->stacksize / 1024);
 	model_print("Analysis plugins:\n");
 	for(unsigned int i=0;i<registeredanalysis->size();i++) {
 		TraceAnalysis * analysis=(*registeredanalysis)[i];
@@ -126,27 +184,41 @@ bool install_plugin(char * name) {
 	return true;
 }
 
+/** @brief The options, for getopt_long() */
+static const char *shortopts = "hyYPt:o:m:M:s:S:f:e:b:u:x:j:J:c:C:r:i:v::";
+static const struct option longopts[] = {
+	{"help", no_argument, NULL, 'h'},
+	{"liveness", required_argument, NULL, 'm'},
+	{"maxfv", required_argument, NULL, 'M'},
+	{"maxfvdelay", required_argument, NULL, 's'},
+	{"fvslop", required_argument, NULL, 'S'},
+	{"fairness", required_argument, NULL, 'f'},
+	{"yield", no_argument, NULL, 'y'},
+	{"yieldblock", no_argument, NULL, 'Y'},
+	{"enabled", required_argument, NULL, 'e'},
+	{"bound", required_argument, NULL, 'b'},
+	{"verbose", optional_argument, NULL, 'v'},
+	{"uninitialized", required_argument, NULL, 'u'},
+	{"analysis", required_argument, NULL, 't'},
+	{"options", required_argument, NULL, 'o'},
+	{"maxexecutions", required_argument, NULL, 'x'},
+	{"jobs", required_argument, NULL, 'j'},
+	{"splitdepth", required_argument, NULL, 'J'},
+	{"checkpoint", required_argument, NULL, 'c'},
+	{"checkpoint-interval", required_argument, NULL, 'C'},
+	{"resume", required_argument, NULL, 'r'},
+	{"snapshot-interval", required_argument, NULL, 'i'},
+	{"profile", no_argument, NULL, 'P'},
+	{"stats-json", required_argument, NULL, OPT_STATS_JSON},
+	{"stack-size", required_argument, NULL, OPT_STACK_SIZE},
+	{"run-to-visible", no_argument, NULL, OPT_RUN_TO_VISIBLE},
+	{"preemption-bound", required_argument, NULL, OPT_PREEMPTION_BOUND},
+	{"delay-bound", required_argument, NULL, OPT_DELAY_BOUND},
+	{0, 0, 0, 0} /* Terminator */
+};
+
 static void parse_options(struct model_params *params, int argc, char **argv)
 {
-	const char *shortopts = "hyYt:o:m:M:s:S:f:e:b:u:x:v::";
-	const struct option longopts[] = {
-		{"help", no_argument, NULL, 'h'},
-		{"liveness", required_argument, NULL, 'm'},
-		{"maxfv", required_argument, NULL, 'M'},
-		{"maxfvdelay", required_argument, NULL, 's'},
-		{"fvslop", required_argument, NULL, 'S'},
-		{"fairness", required_argument, NULL, 'f'},
-		{"yield", no_argument, NULL, 'y'},
-		{"yieldblock", no_argument, NULL, 'Y'},
-		{"enabled", required_argument, NULL, 'e'},
-		{"bound", required_argument, NULL, 'b'},
-		{"verbose", optional_argument, NULL, 'v'},
-		{"uninitialized", required_argument, NULL, 'u'},
-		{"analysis", required_argument, NULL, 't'},
-		{"options", required_argument, NULL, 'o'},
-		{"maxexecutions", required_argument, NULL, 'x'},
-		{0, 0, 0, 0} /* Terminator */
-	};
 	int opt, longindex;
 	bool error = false;
 	while (!error && (opt = getopt_long(argc, argv, shortopts, longopts, &longindex)) != -1) {
@@ -157,6 +229,26 @@ static void parse_options(struct model_params *params, int argc, char **argv)
 		case 'x':
 			params->maxexecutions = atoi(optarg);
 			break;
+		case 'j':
+			params->jobs = atoi(optarg);
+			break;
+		case 'J':
+			params->splitdepth = atoi(optarg);
+			break;
+		case 'c':
+			params->checkpointfile = optarg;
+			break;
+		case 'C':
+			params->checkpointinterval = atoi(optarg);
+			if (params->checkpointinterval == 0)
+				error = true;
+			break;
+		case 'r':
+			params->resumefile = optarg;
+			break;
+		case 'i':
+			params->snapshotinterval = atoi(optarg);
+			break;
 		case 's':
 			params->maxfuturedelay = atoi(optarg);
 			break;
@@ -201,6 +293,30 @@ static void parse_options(struct model_params *params, int argc, char **argv)
 		case 'Y':
 			params->yieldblock = true;
 			break;
+		case 'P':
+			params->profile = true;
+			break;
+		case OPT_STATS_JSON:
+			params->statsjsonfile = optarg;
+			break;
+		case OPT_STACK_SIZE:
+			/* Whole pages, and at least a few of them */
+			params->stacksize = (size_t)strtoul(optarg, NULL, 10) * 1024;
+			params->stacksize = (params->stacksize + PAGESIZE - 1) & ~(size_t)(PAGESIZE - 1);
+			if (params->stacksize < 4 * PAGESIZE || params->stacksize > ((size_t)1 << 32))
+				error = true;
+			break;
+		case OPT_RUN_TO_VISIBLE:
+			params->runtovisible = true;
+			break;
+		case OPT_PREEMPTION_BOUND:
+			params->boundtype = BOUND_PREEMPTIONS;
+			params->maxbound = atoi(optarg);
+			break;
+		case OPT_DELAY_BOUND:
+			params->boundtype = BOUND_DELAYS;
+			params->maxbound = atoi(optarg);
+			break;
 		default: /* '?' */
 			error = true;
 			break;
@@ -217,6 +333,33 @@ static void parse_options(struct model_params *params, int argc, char **argv)
 	/* Reset (global) optind for potential use by user program */
 	optind = 1;
 
+#if !USE_MPROTECT_SNAPSHOT
+	if (params->jobs > 1) {
+		model_print("Parallel exploration is not supported with fork-based snapshotting; running serially\n");
+		params->jobs = 1;
+	}
+	if (params->profile) {
+		model_print("Profiling is not supported with fork-based snapshotting\n");
+		params->profile = false;
+	}
+#endif
+
+	if (params->jobs > 1 && (params->checkpointfile || params->resumefile)) {
+		model_print("Checkpoints are not supported with parallel exploration; running serially\n");
+		params->jobs = 1;
+	}
+
+	if (params->jobs > 1 && params->boundtype != BOUND_NONE) {
+		model_print("Bounded search is not supported with parallel exploration; running serially\n");
+		params->jobs = 1;
+	}
+
+	if (params->boundtype != BOUND_NONE && (params->checkpointfile || params->resumefile)) {
+		model_print("Checkpoints are not supported with bounded search\n");
+		params->checkpointfile = NULL;
+		params->resumefile = NULL;
+	}
+
 	if (error)
 		print_usage(argv[0], params);
 }
@@ -246,6 +389,9 @@ static void model_main()
 
 	parse_options(&params, main_argc, main_argv);
 
+	if (params.profile)
+		profile_init();
+
 	//Initialize race detector
 	initRaceDetector();
 
@@ -261,12 +407,48 @@ static void model_main()
 	DEBUG("Exiting\n");
 }
 
+/**
+ * @brief Re-execute ourselves without address space randomization, if
+ * checkpoints are in use
+ *
+ * Checkpoints record values seen by the program under test, which may be
+ * pointers, so the program must be laid out in memory the same way when
+ * resuming as when the checkpoint was saved. Must be called before anything
+ * else; parse_options() only runs once the snapshotting system is up, so we
+ * scan the options here with the same tables.
+ */
+static void disable_aslr_for_checkpoints(int argc, char **argv)
+{
+	bool checkpoints = false;
+	int opt;
+	/* parse_options() reports any errors later */
+	opterr = 0;
+	while ((opt = getopt_long(argc, argv, shortopts, longopts, NULL)) != -1)
+		if (opt == 'c' || opt == 'r')
+			checkpoints = true;
+	opterr = 1;
+	optind = 1;
+	if (!checkpoints)
+		return;
+
+	int persona = personality(0xffffffff);
+	if (persona == -1 || (persona & ADDR_NO_RANDOMIZE))
+		return;
+	if (personality(persona | ADDR_NO_RANDOMIZE) == -1)
+		return;
+	execv("/proc/self/exe", argv);
+	/* Carry on with randomization; resuming may fail */
+	personality(persona);
+}
+
 /**
  * Main function.  Just initializes snapshotting library and the
  * snapshotting library calls the model_main function.
  */
 int main(int argc, char **argv)
 {
+	disable_aslr_for_checkpoints(argc, argv);
+
 	main_argc = argc;
 	main_argv = argv;
 
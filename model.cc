@@ -1,8 +1,12 @@
 #include <stdio.h>
+#include <errno.h>
 #include <algorithm>
 #include <new>
 #include <stdarg.h>
 #include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/resource.h>
 
 #include "model.h"
 #include "action.h"
@@ -16,9 +20,74 @@
 #include "traceanalysis.h"
 #include "execution.h"
 #include "bugmessage.h"
+#include "parallel.h"
+#include "checkpoint.h"
+#include "profile.h"
+#include "statsjson.h"
 
 ModelChecker *model;
 
+/**
+ * @brief Model-checker state saved along with a mid-execution snapshot
+ *
+ * The snapshotting heap rolls back by itself, but the ModelActions live in the
+ * NodeStack (and so outside of it), as do the program output and the threads'
+ * stacks.
+ */
+struct execution_snapshot {
+	~execution_snapshot() {
+		for (unsigned int i = 0; i < pending.size(); i++)
+			delete pending[i];
+	}
+
+	/** @brief The number of steps taken before the snapshot */
+	int numsteps;
+	/** @brief Copies of the actions in the trace, in trace order */
+	ModelVector<ModelAction> actions;
+	/** @brief Copies of the threads' pending actions (NULL if none) */
+	ModelVector<ModelAction *> pending;
+	/** @brief The length of the program output produced so far */
+	size_t output_len;
+	/** @brief The live parts of the threads' stacks, one after another */
+	ModelVector<char> stacks;
+	/** @brief The length of each thread's part of stacks */
+	ModelVector<size_t> stack_lens;
+
+	MEMALLOC
+};
+
+/**
+ * @brief An alternative left for later, in a bounded search
+ *
+ * Recorded as the path which leads to it, so that it can be replayed from
+ * scratch once we are done with the subtree we are exploring, or once the
+ * bound is high enough.
+ */
+struct bound_point {
+	/** @brief The choices leading to the alternative, which is the last */
+	ModelVector<struct node_choice> path;
+	/** @brief Is the alternative a behavior, rather than a thread? */
+	bool behavior;
+	/** @brief The number of preemptions (or delays) along the path */
+	int cost;
+	/** @brief A hash identifying the path */
+	uint64_t hash;
+	/** @brief A hash identifying the path up to the alternative */
+	uint64_t prefix_hash;
+
+	MEMALLOC
+};
+
+#define BOUND_QUEUED	1	/**< @brief Alternative left for later */
+#define BOUND_EXPLORED	2	/**< @brief Alternative explored already */
+
+/** @brief Turn a path hash into a key for ModelChecker::bound_seen, which
+ *  does not take 0 */
+static uint64_t bound_key(uint64_t hash)
+{
+	return hash ? hash : 1;
+}
+
 /** @brief Constructor */
 ModelChecker::ModelChecker(struct model_params params) :
 	/* Initialize default scheduler */
@@ -31,8 +100,20 @@ ModelChecker::ModelChecker(struct model_params params) :
 	execution_number(1),
 	diverge(NULL),
 	earliest_diverge(NULL),
+	prune_depth(-1),
+	stolen_depth(-1),
+	parallel_total_nodes(0),
+	cur_bound(0),
+	bound_points(),
+	later_bound_points(),
+	bound_seen(),
+	bound_root_depth(-1),
+	bound_root_fixed(false),
+	resuming(false),
+	resume_data(),
 	trace_analyses(),
-	inspect_plugin(NULL)
+	inspect_plugin(NULL),
+	start_time(profile_now())
 {
 	memset(&stats,0,sizeof(struct execution_stats));
 }
@@ -40,6 +121,9 @@ ModelChecker::ModelChecker(struct model_params params) :
 /** @brief Destructor */
 ModelChecker::~ModelChecker()
 {
+	for (unsigned int i = 0; i < snapshots.size(); i++)
+		delete snapshots[i];
+	clear_bound_points();
 	delete node_stack;
 	delete scheduler;
 }
@@ -51,17 +135,109 @@ ModelChecker::~ModelChecker()
 void ModelChecker::reset_to_initial_state()
 {
 	DEBUG("+++ Resetting to initial state +++\n");
-	node_stack->reset_execution();
+	roll_back(0);
+}
 
-	/**
-	 * FIXME: if we utilize partial rollback, we will need to free only
-	 * those pending actions which were NOT pending before the rollback
-	 * point
-	 */
+/**
+ * @brief Record a mid-execution snapshot, if one is worthwhile
+ *
+ * We take snapshots at divergence points, right before diverging: every
+ * execution exploring the subtree below the divergence point can resume from
+ * there instead of replaying the whole path. Dirtying memory after a snapshot
+ * is not free, so snapshots are kept at least params.snapshotinterval steps
+ * apart.
+ *
+ * Must be called between two steps, from the model-checker context.
+ */
+void ModelChecker::record_snapshot()
+{
+	/* Plugins inspecting the actions as they happen would miss the prefix */
+	if (params.snapshotinterval == 0 || !diverge || resuming || inspect_plugin)
+		return;
+
+	int numsteps = diverge->get_node()->get_depth();
+	Node *head = node_stack->get_head();
+	if (!head || head->get_depth() + 1 != numsteps)
+		return;
+	int last = snapshots.empty() ? 0 : snapshots.back()->numsteps;
+	if (numsteps < last + (int)params.snapshotinterval || !snapshot_has_room())
+		return;
+
+	struct execution_snapshot *snap = new execution_snapshot();
+	snap->numsteps = numsteps;
+	action_list_t *trace = execution->get_action_trace();
+	for (action_list_t::iterator it = trace->begin(); it != trace->end(); it++)
+		snap->actions.push_back(**it);
+	for (unsigned int i = 0; i < get_num_threads(); i++) {
+		ModelAction *act = get_thread(int_to_id(i))->get_pending();
+		snap->pending.push_back(act ? new ModelAction(*act) : NULL);
+		size_t len = snap->stacks.size();
+		get_thread(int_to_id(i))->save_stack(&snap->stacks);
+		snap->stack_lens.push_back(snap->stacks.size() - len);
+	}
+	snap->output_len = buffer_program_output();
+	snapshots.push_back(snap);
+
+	snapshot_record(numsteps);
+}
+
+/**
+ * @brief Roll back to the deepest snapshot at or before a given step
+ *
+ * Besides the snapshotting memory, this restores the NodeStack's position,
+ * the ModelActions of the steps already taken (later steps may have updated
+ * them, e.g., when resolving promises), the threads' pending actions and
+ * stacks, and the program output. The result is the state that replaying the path up to the
+ * snapshot would have produced.
+ *
+ * @param numsteps The number of steps along the current path which the next
+ * execution shares with this one
+ */
+void ModelChecker::roll_back(int numsteps)
+{
+	ProfileScope profile(PROFILE_ROLLBACK);
+
+	/* Pending actions never made it into the NodeStack */
 	for (unsigned int i = 0; i < get_num_threads(); i++)
 		delete get_thread(int_to_id(i))->get_pending();
 
-	snapshot_backtrack_before(0);
+	int restored = snapshot_backtrack_before(numsteps);
+	while (!snapshots.empty() && snapshots.back()->numsteps > restored) {
+		delete snapshots.back();
+		snapshots.pop_back();
+	}
+	node_stack->reset_execution(restored);
+	if (restored == 0) {
+		rewind_program_output(0);
+		return;
+	}
+
+	DEBUG("+++ Resuming from the snapshot at step %d +++\n", restored);
+	struct execution_snapshot *snap = snapshots.back();
+	ASSERT(snap->numsteps == restored);
+	rewind_program_output(snap->output_len);
+
+	action_list_t *trace = execution->get_action_trace();
+	unsigned int idx = 0;
+	for (action_list_t::iterator it = trace->begin(); it != trace->end(); it++)
+		**it = snap->actions[idx++];
+	ASSERT(idx == snap->actions.size());
+
+	/* The pending actions at the time of the snapshot have been consumed
+	 * since; hand out fresh copies */
+	size_t stack_pos = 0;
+	for (unsigned int i = 0; i < get_num_threads(); i++) {
+		Thread *thr = get_thread(int_to_id(i));
+		ModelAction *act = snap->pending[i];
+		thr->set_pending(act ? new ModelAction(*act) : NULL);
+		size_t len = snap->stack_lens[i];
+		if (len)
+			thr->restore_stack(&snap->stacks[stack_pos], len);
+		stack_pos += len;
+	}
+
+	/* The backtracking points seen so far may have been explored since */
+	execution->recompute_backtracking();
 }
 
 /** @return the number of user threads created during this execution */
@@ -100,8 +276,29 @@ Thread * ModelChecker::get_next_thread()
 	 * Have we completed exploring the preselected path? Then let the
 	 * scheduler decide
 	 */
-	if (diverge == NULL)
-		return scheduler->select_next_thread(node_stack->get_head());
+	if (diverge == NULL) {
+		Thread *thr;
+		/* Replaying a path handed over by another worker? */
+		const struct node_choice *choice = node_stack->get_replay_choice();
+		if (choice) {
+			for (unsigned int i = 0; i < get_num_threads() && i < 64; i++)
+				if (choice->sleep_set & (1ULL << i))
+					scheduler->add_sleep(get_thread(int_to_id(i)));
+			scheduler->set_scheduler_thread(choice->tid);
+			if (choice->sleep_set)
+				execute_sleep_set();
+			thr = get_thread(choice->tid);
+		} else {
+			thr = scheduler->select_next_thread(node_stack->get_head());
+		}
+		/* We'll explore the new subtree; don't let anyone else take it */
+		if (thr && params.jobs > 1 && prune_depth < 0) {
+			int depth = node_stack->get_head() ? node_stack->get_head()->get_depth() + 1 : 0;
+			if (depth < (int)params.splitdepth)
+				parallel_claim_subtree(node_stack->get_backtrack_hash(depth, thr->get_id()));
+		}
+		return thr;
+	}
 
 
 	/* Else, we are trying to replay an execution */
@@ -113,6 +310,7 @@ Thread * ModelChecker::get_next_thread()
 
 		Node *nextnode = next->get_node();
 		Node *prevnode = nextnode->get_parent();
+		int depth = nextnode->get_depth();
 		scheduler->update_sleep_set(prevnode);
 
 		/* Reached divergence point */
@@ -120,16 +318,26 @@ Thread * ModelChecker::get_next_thread()
 			/* Execute the same thread with a new behavior */
 			tid = next->get_tid();
 			node_stack->pop_restofstack(2);
+			if (params.jobs > 1)
+				claim_subtree(depth, node_stack->get_path_hash(depth + 1));
 		} else {
 			ASSERT(prevnode);
 			/* Make a different thread execute for next step */
 			scheduler->add_sleep(get_thread(next->get_tid()));
+			/* Along with any we gave away to other workers here,
+			 * which we would otherwise have explored first */
+			if (params.jobs > 1)
+				for (int i = 0; i < prevnode->get_num_threads(); i++)
+					if (prevnode->has_been_explored(int_to_id(i)))
+						scheduler->add_sleep(get_thread(int_to_id(i)));
 			tid = prevnode->get_next_backtrack();
 			/* Make sure the backtracked thread isn't sleeping. */
 			node_stack->pop_restofstack(1);
 			if (diverge == earliest_diverge) {
 				earliest_diverge = prevnode->get_action();
 			}
+			if (params.jobs > 1)
+				claim_subtree(depth, node_stack->get_backtrack_hash(depth, tid));
 		}
 		/* Start the round robin scheduler from this thread id */
 		scheduler->set_scheduler_thread(tid);
@@ -147,6 +355,378 @@ Thread * ModelChecker::get_next_thread()
 	return get_thread(id_to_int(tid));
 }
 
+/**
+ * @brief Try to claim the subtree at a divergence point, in parallel mode
+ *
+ * Only divergence points shallower than the split depth are shared between
+ * workers; deeper ones belong to whoever owns the enclosing subtree. If
+ * another worker already owns the subtree, we run through it once (without
+ * counting the execution) and then prune it.
+ *
+ * @param depth The depth of the root of the new subtree
+ * @param path_hash A hash of the choices leading to the new subtree
+ */
+void ModelChecker::claim_subtree(int depth, uint64_t path_hash)
+{
+	if (depth >= (int)params.splitdepth)
+		return;
+	if (parallel_claim_subtree(path_hash))
+		prune_depth = -1;
+	else
+		prune_depth = depth;
+}
+
+/**
+ * @brief Check whether a backtracking point belongs to someone else
+ * @param act The action at which we might diverge
+ * @return True if we should not diverge at act, since it lies within a subtree
+ * that another parallel worker is exploring, or outside the subtree we are
+ * exploring in a bounded search (see defer_backtrack())
+ */
+bool ModelChecker::is_pruned_backtrack(const ModelAction *act) const
+{
+	if (bound_root_depth >= 0)
+		return act->get_node()->get_depth() < bound_root_depth + (bound_root_fixed ? 1 : 0);
+	return prune_depth >= 0 && act->get_node()->get_depth() > prune_depth;
+}
+
+/**
+ * @brief Check whether running a thread at a Node would exceed the bound, in
+ * a bounded search
+ * @param node The Node after which the thread would run
+ * @param tid The thread
+ * @return True if the bound rules out running tid after node in this round
+ */
+bool ModelChecker::is_beyond_bound(const Node *node, thread_id_t tid) const
+{
+	return params.boundtype != BOUND_NONE &&
+		node->get_bound_count() + node->get_bound_cost(tid) > (int)cur_bound;
+}
+
+/**
+ * @brief Leave a backtracking point for later, in a bounded search
+ *
+ * A point beyond the bound waits for the round whose bound covers it. A point
+ * above the root of the subtree we are exploring (see bound_root_depth) waits
+ * until we are done with that subtree. Either way, we replay the path to the
+ * point from scratch when its turn comes (see next_bound_point()).
+ *
+ * @param node The Node at which we should backtrack
+ * @param tid The thread to run instead
+ * @return True if the point was left for later, so we should not backtrack
+ * there now
+ */
+bool ModelChecker::defer_backtrack(Node *node, thread_id_t tid)
+{
+	if (params.boundtype == BOUND_NONE)
+		return false;
+	int depth = node->get_depth();
+	int cost = node->get_bound_count() + node->get_bound_cost(tid);
+	if (depth >= bound_root_depth && cost <= (int)cur_bound)
+		return false;
+
+	struct bound_point *point = new bound_point();
+	point->path.resize(depth + 2);
+	node_stack->get_backtrack_path(depth, tid, &point->path[0], &point->hash);
+	point->prefix_hash = node_stack->get_path_hash(depth + 1);
+	point->behavior = false;
+	point->cost = cost;
+	queue_bound_point(point);
+	return true;
+}
+
+/**
+ * @brief Leave a new future value for later, if it lies above the subtree we
+ * are exploring in a bounded search
+ *
+ * The alternatives at the steps along the path we replayed were left to
+ * whoever explored that path first; except for the future values, which only
+ * turn up once some later write has been explored.
+ *
+ * @param node The Node of the read which may read the future value
+ * @param fv The future value
+ * @return True if the future value was left for later, so we should not
+ * explore it now
+ */
+bool ModelChecker::defer_future_value(Node *node, const struct future_value *fv)
+{
+	int depth = node->get_depth();
+	if (bound_root_depth < 0 || depth > bound_root_depth ||
+			(depth == bound_root_depth && !bound_root_fixed))
+		return false;
+
+	struct node_choice choice;
+	node->get_choice(&choice);
+	choice.read_from_status = READ_FROM_FUTURE;
+	choice.rf_seq = 0;
+	choice.fv = *fv;
+	choice.resolve_promise_idx = -1;
+
+	struct bound_point *point = new bound_point();
+	point->path.resize(depth + 1);
+	node_stack->get_behavior_path(depth, &choice, &point->path[0], &point->hash);
+	point->behavior = true;
+	point->cost = node->get_bound_count();
+	queue_bound_point(point);
+	return true;
+}
+
+/**
+ * @brief Add an alternative to the ones left for later, in a bounded search
+ *
+ * Alternatives which were explored already, or left for later already (since
+ * several executions may run into the same one), are dropped.
+ *
+ * @param point The alternative; we take ownership of it
+ */
+void ModelChecker::queue_bound_point(struct bound_point *point)
+{
+	if (bound_seen.get(bound_key(point->hash)) != 0) {
+		delete point;
+		return;
+	}
+	bound_seen.put(bound_key(point->hash), BOUND_QUEUED);
+	if (point->cost > (int)cur_bound)
+		later_bound_points.push_back(point);
+	else
+		bound_points.push_back(point);
+}
+
+/**
+ * @brief Record the alternatives explored by the current execution, in a
+ * bounded search
+ *
+ * That is, the thread choices and the behaviors along its path, so that we
+ * don't explore them again when some other subtree runs into them.
+ */
+void ModelChecker::record_bound_explored()
+{
+	ModelVector<uint64_t> hashes;
+	node_stack->get_choice_hashes(&hashes);
+	for (unsigned int i = 0; i < hashes.size(); i++)
+		bound_seen.put(bound_key(hashes[i]), BOUND_EXPLORED);
+}
+
+/**
+ * @brief Start exploring the next alternative left for later, in a bounded
+ * search
+ *
+ * Called once we are done with the subtree we were exploring. We replay the
+ * path to the next alternative within the bound, raising the bound first if
+ * there is none (see raise_bound()).
+ *
+ * @return True if there is another alternative to explore
+ */
+bool ModelChecker::next_bound_point()
+{
+	if (params.boundtype == BOUND_NONE)
+		return false;
+
+	/* Either way, we are done with the last execution. Its bugs have been
+	 * reported already, and which execution comes last depends on the
+	 * bound, so don't leave its pending release sequences for
+	 * fixup_release_sequences() */
+	reset_to_initial_state();
+	while (params.maxexecutions == 0 || stats.num_complete < (int)params.maxexecutions) {
+		if (bound_points.empty() && !raise_bound())
+			return false;
+		struct bound_point *point = bound_points.back();
+		bound_points.pop_back();
+		if (bound_seen.get(bound_key(point->hash)) == BOUND_EXPLORED) {
+			delete point;
+			continue;
+		}
+
+		/* Sleep, after the threads explored here since we left it */
+		if (!point->behavior) {
+			struct node_choice *root = &point->path.back();
+			for (int i = 0; i < 64; i++) {
+				struct node_choice choice;
+				Node::get_default_choice(int_to_id(i), &choice);
+				uint64_t hash = Node::hash_choice(point->prefix_hash, &choice);
+				if (i != id_to_int(root->tid) && bound_seen.get(bound_key(hash)) == BOUND_EXPLORED)
+					root->sleep_set |= 1ULL << i;
+			}
+		}
+		node_stack->set_replay_prefix(&point->path[0], point->path.size());
+		diverge = NULL;
+		earliest_diverge = NULL;
+		bound_root_depth = point->path.size() - 1;
+		bound_root_fixed = point->behavior;
+		delete point;
+		execution_number++;
+		return true;
+	}
+	return false;
+}
+
+/**
+ * @brief Start the next round of a bounded search, if there should be one
+ *
+ * The alternatives left out of the last round for being beyond the bound are
+ * all there is left to explore; we raise the bound to the lowest cost among
+ * them (usually one more; a single choice may cost several delays) and take up
+ * those within it. There is no next round if none were left out (so the search
+ * is complete), they are all beyond the maximum bound, or we found a bug.
+ *
+ * @return True if there is another round to explore
+ */
+bool ModelChecker::raise_bound()
+{
+	if (later_bound_points.empty() || stats.num_buggy_executions > 0)
+		return false;
+
+	int lowest = later_bound_points[0]->cost;
+	for (unsigned int i = 1; i < later_bound_points.size(); i++)
+		lowest = std::min(lowest, later_bound_points[i]->cost);
+	if (lowest > (int)params.maxbound)
+		return false;
+
+	cur_bound = lowest;
+	model_print("******* Raising the %s bound to %u: *******\n",
+			params.boundtype == BOUND_PREEMPTIONS ? "preemption" : "delay", cur_bound);
+
+	unsigned int left = 0;
+	for (unsigned int i = 0; i < later_bound_points.size(); i++) {
+		struct bound_point *point = later_bound_points[i];
+		if (point->cost <= (int)cur_bound)
+			bound_points.push_back(point);
+		else
+			later_bound_points[left++] = point;
+	}
+	later_bound_points.resize(left);
+	return true;
+}
+
+/** @brief Forget all about the alternatives of a bounded search */
+void ModelChecker::clear_bound_points()
+{
+	for (unsigned int i = 0; i < bound_points.size(); i++)
+		delete bound_points[i];
+	bound_points.clear();
+	for (unsigned int i = 0; i < later_bound_points.size(); i++)
+		delete later_bound_points[i];
+	later_bound_points.clear();
+	bound_seen.reset();
+	bound_root_depth = -1;
+	bound_root_fixed = false;
+}
+
+/**
+ * @brief Hand one of our unexplored subtrees to an idle worker, if any
+ *
+ * Only alternatives strictly above the upcoming divergence point (and above
+ * the split depth) are given away, so that the next execution is undisturbed;
+ * and only those within our own subtree, if we stole it (see steal_work()).
+ */
+void ModelChecker::donate_work()
+{
+	if (!parallel_want_donation())
+		return;
+
+	int maxdepth = diverge->get_node()->get_depth() - 1;
+	if (maxdepth > (int)params.splitdepth - 1)
+		maxdepth = params.splitdepth - 1;
+	if (maxdepth > PARALLEL_MAX_PATH - 1)
+		maxdepth = PARALLEL_MAX_PATH - 1;
+
+	struct node_choice path[PARALLEL_MAX_PATH];
+	uint64_t hash;
+	int len;
+	while ((len = node_stack->donate_alternative(stolen_depth, maxdepth, path, &hash)) > 0) {
+		/* Someone else may already own it */
+		if (!parallel_claim_subtree(hash))
+			continue;
+		parallel_donate(path, len);
+		return;
+	}
+}
+
+/**
+ * @brief Wait for another worker to hand us a subtree to explore
+ * @return True if we have a new subtree; false if all workers are done
+ */
+bool ModelChecker::steal_work()
+{
+	struct node_choice path[PARALLEL_MAX_PATH];
+	int len = parallel_steal(path);
+	if (len == 0)
+		return false;
+
+	if (DBG_ENABLED())
+		model_print("Stole a subtree at depth %d\n", len - 1);
+
+	reset_to_initial_state();
+	node_stack->set_replay_prefix(path, len);
+	diverge = NULL;
+	earliest_diverge = NULL;
+	prune_depth = -1;
+	/* The alternatives along the prefix still belong to the donor: we
+	 * only reach them through claim_subtree(), like everyone else */
+	stolen_depth = len - 1;
+	execution_number++;
+	return true;
+}
+
+/**
+ * @brief Save our progress to the checkpoint file
+ *
+ * Should be called at the end of an execution, before any divergence.
+ * Failure to write the checkpoint is reported, but is not fatal.
+ */
+void ModelChecker::save_checkpoint()
+{
+	checkpoint_buf_t buf;
+	checkpoint_append(&buf, CHECKPOINT_MAGIC, sizeof(CHECKPOINT_MAGIC));
+	checkpoint_append(&buf, &stats, sizeof(stats));
+	checkpoint_append(&buf, &execution_number, sizeof(execution_number));
+	node_stack->save_checkpoint(&buf);
+	if (!checkpoint_write_file(params.checkpointfile, &buf))
+		model_print("Error: could not write checkpoint %s: %s\n", params.checkpointfile, strerror(errno));
+}
+
+/**
+ * @brief Load the checkpoint to resume from
+ *
+ * Restores the stats, and sets up the first execution to replay the path
+ * saved in the checkpoint. That execution is not counted; finish_resume()
+ * takes over at the end of it.
+ */
+void ModelChecker::start_resume()
+{
+	char magic[sizeof(CHECKPOINT_MAGIC)];
+	if (!checkpoint_read_file(params.resumefile, &resume_data)) {
+		model_print("Error: could not read checkpoint %s: %s\n", params.resumefile, strerror(errno));
+		exit(EXIT_FAILURE);
+	}
+	struct checkpoint_cursor cur = { &resume_data[0], &resume_data[0] + resume_data.size() };
+	if (!checkpoint_take(&cur, magic, sizeof(magic)) ||
+			memcmp(magic, CHECKPOINT_MAGIC, sizeof(magic)) ||
+			!checkpoint_take(&cur, &stats, sizeof(stats)) ||
+			!checkpoint_take(&cur, &execution_number, sizeof(execution_number)) ||
+			!node_stack->load_checkpoint(&cur)) {
+		model_print("Error: %s is not a valid checkpoint\n", params.resumefile);
+		exit(EXIT_FAILURE);
+	}
+	resume_nodes = cur;
+	resuming = true;
+	model_print("Resuming from checkpoint %s at execution %d\n", params.resumefile, execution_number);
+}
+
+/** @brief Restore the exploration state, once the checkpoint's path has been
+ *  replayed */
+void ModelChecker::finish_resume()
+{
+	if (!node_stack->restore_checkpoint(&resume_nodes)) {
+		model_print("Error: checkpoint %s does not match this program\n", params.resumefile);
+		exit(EXIT_FAILURE);
+	}
+	resuming = false;
+	resume_data.clear();
+	/* The backtracking points seen during the replay are out of date */
+	execution->recompute_backtracking();
+}
+
 /**
  * We need to know what the next actions of all threads in the sleep
  * set will be.  This method computes them and stores the actions at
@@ -172,10 +752,11 @@ void ModelChecker::execute_sleep_set()
  * the current trace is not yet feasible, the error message will be stashed and
  * printed if the execution ever becomes feasible.
  *
+ * @param type The kind of bug
  * @param msg Descriptive message for the bug (do not include newline char)
  * @return True if bug is immediately-feasible
  */
-bool ModelChecker::assert_bug(const char *msg, ...)
+bool ModelChecker::assert_bug(enum bug_type type, const char *msg, ...)
 {
 	char str[800];
 
@@ -184,7 +765,7 @@ bool ModelChecker::assert_bug(const char *msg, ...)
 	vsnprintf(str, sizeof(str), msg, ap);
 	va_end(ap);
 
-	return execution->assert_bug(str);
+	return execution->assert_bug(type, str);
 }
 
 /**
@@ -195,7 +776,7 @@ bool ModelChecker::assert_bug(const char *msg, ...)
 void ModelChecker::assert_user_bug(const char *msg)
 {
 	/* If feasible bug, bail out now */
-	if (assert_bug(msg))
+	if (assert_bug(BUG_USER_ASSERTION, "%s", msg))
 		switch_to_master(NULL);
 }
 
@@ -222,8 +803,12 @@ void ModelChecker::record_stats()
 	stats.num_total++;
 	if (!execution->isfeasibleprefix())
 		stats.num_infeasible++;
-	else if (execution->have_bug_reports())
+	else if (execution->have_bug_reports()) {
 		stats.num_buggy_executions++;
+		SnapVector<bug_message *> *bugs = execution->get_bugs();
+		for (unsigned int i = 0; i < bugs->size(); i++)
+			stats.num_bugs[(*bugs)[i]->type]++;
+	}
 	else if (execution->is_complete_execution())
 		stats.num_complete++;
 	else {
@@ -246,8 +831,119 @@ void ModelChecker::print_stats() const
 	model_print("Number of buggy executions: %d\n", stats.num_buggy_executions);
 	model_print("Number of infeasible executions: %d\n", stats.num_infeasible);
 	model_print("Total executions: %d\n", stats.num_total);
-	if (params.verbose)
-		model_print("Total nodes created: %d\n", node_stack->get_total_nodes());
+	if (params.boundtype != BOUND_NONE)
+		model_print("%s bound: %u%s\n",
+				params.boundtype == BOUND_PREEMPTIONS ? "Preemption" : "Delay", cur_bound,
+				bound_points.empty() && later_bound_points.empty() ? "" :
+				" (executions beyond the bound were left out)");
+	if (params.verbose) {
+		model_print("Total nodes created: %d\n", get_total_nodes());
+		/* The parent of parallel workers does no race detection */
+		if (params.jobs <= 1 || parallel_is_worker()) {
+			uint64_t hits, misses;
+			getShadowCacheStats(&hits, &misses);
+			model_print("Shadow table lookups: %llu cache hits, %llu misses\n",
+					(unsigned long long)hits, (unsigned long long)misses);
+		}
+	}
+}
+
+/** @brief Names for the bug types, in the exported statistics */
+static const char * const bug_type_names[NUM_BUG_TYPES] = {
+	"user_assertion",
+	"data_race",
+	"deadlock",
+	"uninitialized_load",
+	"uninitialized_lock",
+};
+
+/**
+ * @brief Export the run statistics to the --stats-json file
+ *
+ * Besides the execution stats, this records the throughput, the peak memory
+ * usage (of the parallel workers too, if any) and the statistics of the trace
+ * analyses. In parallel mode, it is the parent which exports the combined
+ * results; the trace analyses run in the workers, so their statistics are
+ * exported per worker (see write_plugin_stats()).
+ */
+void ModelChecker::write_stats_json() const
+{
+	int fd = open(params.statsjsonfile, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0) {
+		model_print("Error: could not write statistics to %s: %s\n", params.statsjsonfile, strerror(errno));
+		return;
+	}
+
+	double seconds = (profile_now() - start_time) / 1e9;
+	struct stats_json json;
+	stats_json_begin(&json, fd);
+	stats_json_string(&json, "program", params.argv[0]);
+	stats_json_begin_object(&json, "executions");
+	stats_json_uint(&json, "total", stats.num_total);
+	stats_json_uint(&json, "complete", stats.num_complete);
+	stats_json_uint(&json, "redundant", stats.num_redundant);
+	stats_json_uint(&json, "buggy", stats.num_buggy_executions);
+	stats_json_uint(&json, "infeasible", stats.num_infeasible);
+	stats_json_end_object(&json);
+	stats_json_uint(&json, "total_nodes", get_total_nodes());
+	if (params.boundtype != BOUND_NONE)
+		stats_json_uint(&json, "bound", cur_bound);
+	stats_json_double(&json, "wall_time_sec", seconds);
+	stats_json_double(&json, "executions_per_sec", seconds > 0 ? stats.num_total / seconds : 0);
+
+	long peak_kb = 0;
+	struct rusage usage;
+	if (getrusage(RUSAGE_SELF, &usage) == 0)
+		peak_kb = usage.ru_maxrss;
+	if (params.jobs > 1 && getrusage(RUSAGE_CHILDREN, &usage) == 0 && usage.ru_maxrss > peak_kb)
+		peak_kb = usage.ru_maxrss;
+	stats_json_uint(&json, "peak_rss_kb", peak_kb);
+
+	stats_json_begin_object(&json, "bugs");
+	for (int i = 0; i < NUM_BUG_TYPES; i++)
+		stats_json_uint(&json, bug_type_names[i], stats.num_bugs[i]);
+	stats_json_end_object(&json);
+
+	stats_json_begin_object(&json, "plugins");
+	if (params.jobs > 1)
+		parallel_export_plugin_stats(&json);
+	else
+		export_plugin_stats(&json);
+	stats_json_end_object(&json);
+	stats_json_end(&json);
+
+	if (close(fd) != 0)
+		model_print("Error: could not write statistics to %s: %s\n", params.statsjsonfile, strerror(errno));
+}
+
+/** @brief Export the statistics of each trace analysis, as one object each */
+void ModelChecker::export_plugin_stats(struct stats_json *json) const
+{
+	for (unsigned int i = 0; i < trace_analyses.size(); i++) {
+		stats_json_begin_object(json, trace_analyses[i]->name());
+		trace_analyses[i]->exportStats(json);
+		stats_json_end_object(json);
+	}
+}
+
+/**
+ * @brief Hand the statistics of our trace analyses to the parent process, as
+ * a JSON document, for it to export in the --stats-json file
+ */
+void ModelChecker::write_plugin_stats() const
+{
+	struct stats_json json;
+	stats_json_begin(&json, parallel_plugin_stats_fd());
+	export_plugin_stats(&json);
+	stats_json_end(&json);
+}
+
+/** @return The number of NodeStack nodes created, across all workers */
+int ModelChecker::get_total_nodes() const
+{
+	if (params.jobs > 1 && !parallel_is_worker())
+		return parallel_total_nodes;
+	return node_stack->get_total_nodes();
 }
 
 /**
@@ -291,27 +987,33 @@ void ModelChecker::print_execution(bool printbugs) const
 bool ModelChecker::next_execution()
 {
 	DBG();
+	/* Did we just run through a subtree owned by another worker, or
+	 * replay the path to a checkpoint? */
+	bool pruned = prune_depth >= 0 || resuming;
 	/* Is this execution a feasible execution that's worth bug-checking? */
-	bool complete = execution->isfeasibleprefix() &&
+	bool complete = !pruned && execution->isfeasibleprefix() &&
 		(execution->is_complete_execution() ||
 		 execution->have_bug_reports());
 
 	/* End-of-execution bug checks */
 	if (complete) {
 		if (execution->is_deadlocked())
-			assert_bug("Deadlock detected");
+			assert_bug(BUG_DEADLOCK, "Deadlock detected");
 
 		checkDataRaces();
 		run_trace_analyses();
-	} else if (inspect_plugin && !execution->is_complete_execution() &&
+	} else if (!pruned && inspect_plugin && !execution->is_complete_execution() &&
 		(execution->too_many_steps())) {
 		 inspect_plugin->analyze(execution->get_action_trace());
 	}
 
-	record_stats();
+	if (!pruned)
+		record_stats();
 
 	/* Output */
-	if ( (complete && params.verbose) || params.verbose>1 || (complete && execution->have_bug_reports()))
+	if (pruned)
+		clear_program_output();
+	else if ( (complete && params.verbose) || params.verbose>1 || (complete && execution->have_bug_reports()))
 		print_execution(complete);
 	else
 		clear_program_output();
@@ -319,6 +1021,9 @@ bool ModelChecker::next_execution()
 	if (complete)
 		earliest_diverge = NULL;
 
+	if (resuming)
+		finish_resume();
+
 	if (restart_flag) {
 		do_restart();
 		return true;
@@ -327,20 +1032,32 @@ bool ModelChecker::next_execution()
 	if (exit_flag)
 		return false;
 
+	if (params.boundtype != BOUND_NONE)
+		record_bound_explored();
+
 	if ((diverge = execution->get_next_backtrack()) == NULL)
-		return false;
+		return next_bound_point() || (parallel_is_worker() && steal_work());
+
+	if (parallel_is_worker())
+		donate_work();
 
 	if (DBG_ENABLED()) {
 		model_print("Next execution will diverge at:\n");
 		diverge->print();
 	}
 
+	bool stop = params.maxexecutions != 0 && stats.num_complete >= (int)params.maxexecutions;
+	/* Always save a checkpoint when stopping early, so that a later run can
+	 * pick up where we left off */
+	if (params.checkpointfile && (stop || execution_number % params.checkpointinterval == 0))
+		save_checkpoint();
+
 	execution_number++;
 
-	if (params.maxexecutions != 0 && stats.num_complete >= (int)params.maxexecutions)
+	if (stop)
 		return false;
 
-	reset_to_initial_state();
+	roll_back(diverge->get_node()->get_depth());
 	return true;
 }
 
@@ -391,6 +1108,9 @@ void ModelChecker::switch_from_master(Thread *thread)
  * model-checking action (described by a ModelAction object). Must be called
  * from a user-thread context.
  *
+ * In run-to-visible mode, an action which no other thread can observe is
+ * explored right away, without leaving the user thread.
+ *
  * @param act The current action that will be explored. May be NULL only if
  * trace is exiting via an assertion (see ModelExecution::set_assert and
  * ModelExecution::has_asserted).
@@ -405,6 +1125,16 @@ uint64_t ModelChecker::switch_to_master(ModelAction *act)
 	if (inspect_plugin != NULL) {
 		inspect_plugin->inspectModelAction(act);
 	}
+	if (params.runtovisible && act && !execution->has_asserted() && execution->is_invisible(act)) {
+		/* No need for a scheduling point; take the step right here */
+		execution->take_invisible_step(act);
+		if (!should_terminate_execution()) {
+			scheduler->set_current_thread(old);
+			return old->get_return_value();
+		}
+		/* Return to the run loop, which will see that we're done */
+		act = NULL;
+	}
 	old->set_pending(act);
 	if (Thread::swap(old, &system_context) < 0) {
 		perror("swap threads");
@@ -455,6 +1185,8 @@ void ModelChecker::do_restart()
 	earliest_diverge = NULL;
 	reset_to_initial_state();
 	node_stack->full_reset();
+	clear_bound_points();
+	cur_bound = 0;
 	memset(&stats,0,sizeof(struct execution_stats));
 	execution_number = 1;
 }
@@ -463,12 +1195,42 @@ void ModelChecker::do_restart()
 void ModelChecker::run()
 {
 	bool has_next;
+
+	if (params.jobs > 1) {
+		if (!parallel_start_workers(params.jobs)) {
+			/* All workers are done; report the combined results */
+			parallel_collect_stats(&stats, &parallel_total_nodes);
+			model_print("******* Model-checking complete: *******\n");
+			print_stats();
+			if (params.statsjsonfile)
+				write_stats_json();
+			return;
+		}
+		/* Worker 0 owns the initial execution; the others start out
+		 * pruning everything below the split depth */
+		if (parallel_worker_id() != 0)
+			prune_depth = params.splitdepth - 1;
+	}
+
+	if (params.resumefile)
+		start_resume();
+
 	do {
-		thrd_t user_thread;
-		Thread *t = new Thread(execution->get_next_id(), &user_thread, &user_main_wrapper, NULL, NULL);
-		execution->add_thread(t);
+		Thread *t = NULL;
+		/* Start up the program, unless we resumed from a snapshot */
+		if (!node_stack->get_head()) {
+			thrd_t user_thread;
+			Thread *main_thread = new Thread(execution->get_next_id(), &user_thread, &user_main_wrapper, NULL, NULL);
+			execution->add_thread(main_thread);
+			/* Its start-up is the first step, unless that's invisible */
+			if (!params.runtovisible)
+				t = main_thread;
+		}
 
 		do {
+			if (!t)
+				record_snapshot();
+
 			/*
 			 * Stash next pending action(s) for thread(s). There
 			 * should only need to stash one thread's action--the
@@ -481,7 +1243,7 @@ void ModelChecker::run()
 				if (!thr->is_model_thread() && !thr->is_complete() && !thr->get_pending()) {
 					switch_from_master(thr);
 					if (thr->is_waiting_on(thr))
-						assert_bug("Deadlock detected (thread %u)", i);
+						assert_bug(BUG_DEADLOCK, "Deadlock detected (thread %u)", i);
 				}
 			}
 
@@ -498,6 +1260,9 @@ void ModelChecker::run()
 			 * between-ModelAction bugs (e.g., data races) */
 			if (execution->has_asserted())
 				break;
+			/* ...or an invisible step which ended the execution */
+			if (params.runtovisible && should_terminate_execution())
+				break;
 
 			if (!t)
 				t = get_next_thread();
@@ -524,10 +1289,25 @@ void ModelChecker::run()
 
 	execution->fixup_release_sequences();
 
-	model_print("******* Model-checking complete: *******\n");
-	print_stats();
+	if (parallel_is_worker()) {
+		parallel_report_stats(&stats, node_stack->get_total_nodes());
+		if (params.verbose)
+			print_stats();
+	} else {
+		model_print("******* Model-checking complete: *******\n");
+		print_stats();
+	}
+
+	profile_print();
 
 	/* Have the trace analyses dump their output. */
 	for (unsigned int i = 0; i < trace_analyses.size(); i++)
 		trace_analyses[i]->finish();
+
+	if (!params.statsjsonfile)
+		return;
+	if (parallel_is_worker())
+		write_plugin_stats();
+	else
+		write_stats_json();
 }
@@ -10,11 +10,14 @@
 
 #include "mymemory.h"
 #include "hashtable.h"
+#include "chunklist.h"
 #include "config.h"
 #include "modeltypes.h"
 #include "stl-model.h"
 #include "context.h"
 #include "params.h"
+#include "checkpoint.h"
+#include "bugmessage.h"
 
 /* Forward declaration */
 class Node;
@@ -27,8 +30,12 @@ class ClockVector;
 class TraceAnalysis;
 class ModelExecution;
 class ModelAction;
+struct execution_snapshot;
+struct bound_point;
+struct stats_json;
+struct future_value;
 
-typedef SnapList<ModelAction *> action_list_t;
+typedef ChunkList<ModelAction *> action_list_t;
 
 /** @brief Model checker execution stats */
 struct execution_stats {
@@ -37,6 +44,8 @@ struct execution_stats {
 	int num_buggy_executions; /** @brief Number of buggy executions */
 	int num_complete; /**< @brief Number of feasible, non-buggy, complete executions */
 	int num_redundant; /**< @brief Number of redundant, aborted executions */
+	/** @brief Number of bugs of each type reported by buggy executions */
+	int num_bugs[NUM_BUG_TYPES];
 };
 
 /** @brief The central structure for model-checking */
@@ -57,7 +66,7 @@ public:
 	bool get_exit_flag() const { return exit_flag; }
 
 	/** @returns the context for the main model-checking system thread */
-	ucontext_t * get_system_context() { return &system_context; }
+	model_context_t * get_system_context() { return &system_context; }
 
 	ModelExecution * get_execution() const { return execution; }
 
@@ -71,7 +80,12 @@ public:
 	void switch_from_master(Thread *thread);
 	uint64_t switch_to_master(ModelAction *act);
 
-	bool assert_bug(const char *msg, ...);
+	bool is_pruned_backtrack(const ModelAction *act) const;
+	bool is_beyond_bound(const Node *node, thread_id_t tid) const;
+	bool defer_backtrack(Node *node, thread_id_t tid);
+	bool defer_future_value(Node *node, const struct future_value *fv);
+
+	bool assert_bug(enum bug_type type, const char *msg, ...);
 	void assert_user_bug(const char *msg);
 
 	const model_params params;
@@ -101,11 +115,82 @@ private:
 	Thread * get_next_thread();
 	void reset_to_initial_state();
 
+	/** @brief The mid-execution snapshots along the current path,
+	 *  shallowest first */
+	ModelVector<struct execution_snapshot *> snapshots;
+	void record_snapshot();
+	void roll_back(int numsteps);
+
 
 	ModelAction *diverge;
 	ModelAction *earliest_diverge;
 
-	ucontext_t system_context;
+	/**
+	 * @brief Depth of the root of the subtree we are currently pruning
+	 *
+	 * In parallel mode, this is non-negative while we run an (uncounted)
+	 * execution into a subtree that another worker has claimed. Any
+	 * backtracking points deeper than this are left to that worker.
+	 * Negative when we own the current subtree.
+	 */
+	int prune_depth;
+	/**
+	 * @brief Depth of the root of the subtree we took over from another
+	 * worker
+	 *
+	 * The alternatives at or above it belong to the worker which donated
+	 * the subtree, so we never give them away again. Negative if we never
+	 * stole any work.
+	 */
+	int stolen_depth;
+	/** @brief Sum of the NodeStack sizes of all parallel workers */
+	int parallel_total_nodes;
+	void claim_subtree(int depth, uint64_t path_hash);
+	void donate_work();
+	bool steal_work();
+	int get_total_nodes() const;
+
+	/** @brief The bound of the current round of a bounded search */
+	unsigned int cur_bound;
+	/** @brief The alternatives left for later in the current round of a
+	 *  bounded search, since they lie outside the subtree being explored */
+	ModelVector<struct bound_point *> bound_points;
+	/** @brief The alternatives left out of the current round for being
+	 *  beyond the bound */
+	ModelVector<struct bound_point *> later_bound_points;
+	/** @brief The hashes of the paths to every alternative explored
+	 *  (BOUND_EXPLORED) or left for later (BOUND_QUEUED) so far */
+	HashTable<uint64_t, int, uint64_t, 0, model_malloc, model_calloc, model_free> bound_seen;
+	/**
+	 * @brief Depth of the root of the subtree we are exploring, in a
+	 * bounded search
+	 *
+	 * Set when we replay the path to an alternative left for later. The
+	 * threads to run after the Nodes above the root, and the behaviors of
+	 * the steps above it, lie outside the subtree. Negative while exploring
+	 * the whole tree.
+	 */
+	int bound_root_depth;
+	/** @brief Is the behavior at the root of that subtree fixed too (i.e.,
+	 *  was the alternative a behavior, rather than a thread)? */
+	bool bound_root_fixed;
+	void queue_bound_point(struct bound_point *point);
+	void record_bound_explored();
+	bool next_bound_point();
+	bool raise_bound();
+	void clear_bound_points();
+
+	/** @brief Are we replaying the path saved in a checkpoint? */
+	bool resuming;
+	/** @brief The contents of the checkpoint we are resuming from */
+	checkpoint_buf_t resume_data;
+	/** @brief The part of resume_data which describes the NodeStack */
+	struct checkpoint_cursor resume_nodes;
+	void save_checkpoint();
+	void start_resume();
+	void finish_resume();
+
+	model_context_t system_context;
 
 	ModelVector<TraceAnalysis *> trace_analyses;
 
@@ -120,6 +205,11 @@ private:
 	void print_bugs() const;
 	void print_execution(bool printbugs) const;
 	void print_stats() const;
+	/** @brief The time at which the model checker started, in ns */
+	uint64_t start_time;
+	void write_stats_json() const;
+	void export_plugin_stats(struct stats_json *json) const;
+	void write_plugin_stats() const;
 
 	friend void user_main_wrapper();
 };
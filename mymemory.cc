@@ -10,6 +10,7 @@
 #include "common.h"
 #include "threads-model.h"
 #include "model.h"
+#include "profile.h"
 
 #define REQUESTS_BEFORE_ALLOC 1024
 
@@ -78,6 +79,7 @@ void * snapshot_malloc(size_t size)
 {
 	void *tmp = mspace_malloc(model_snapshot_space, size);
 	ASSERT(tmp);
+	profile_heap_alloc(PROFILE_MODEL_HEAP, tmp);
 	return tmp;
 }
 
@@ -86,20 +88,24 @@ void * snapshot_calloc(size_t count, size_t size)
 {
 	void *tmp = mspace_calloc(model_snapshot_space, count, size);
 	ASSERT(tmp);
+	profile_heap_alloc(PROFILE_MODEL_HEAP, tmp);
 	return tmp;
 }
 
 /** @brief Snapshotting realloc, for use by model-checker (not user progs) */
 void *snapshot_realloc(void *ptr, size_t size)
 {
+	profile_heap_free(PROFILE_MODEL_HEAP, ptr);
 	void *tmp = mspace_realloc(model_snapshot_space, ptr, size);
 	ASSERT(tmp);
+	profile_heap_alloc(PROFILE_MODEL_HEAP, tmp);
 	return tmp;
 }
 
 /** @brief Snapshotting free, for use by model-checker (not user progs) */
 void snapshot_free(void *ptr)
 {
+	profile_heap_free(PROFILE_MODEL_HEAP, ptr);
 	mspace_free(model_snapshot_space, ptr);
 }
 
@@ -170,6 +176,7 @@ static void * user_malloc(size_t size)
 {
 	void *tmp = mspace_malloc(user_snapshot_space, size);
 	ASSERT(tmp);
+	profile_heap_alloc(PROFILE_USER_HEAP, tmp);
 	return tmp;
 }
 
@@ -199,6 +206,7 @@ void free(void * ptr)
 		if (switch_alloc) {
 			return model_free(ptr);
 		}
+		profile_heap_free(PROFILE_USER_HEAP, ptr);
 		mspace_free(user_snapshot_space, ptr);
 	}
 }
@@ -206,8 +214,10 @@ void free(void * ptr)
 /** @brief Snapshotting realloc implementation for user programs */
 void *realloc(void *ptr, size_t size)
 {
+	profile_heap_free(PROFILE_USER_HEAP, ptr);
 	void *tmp = mspace_realloc(user_snapshot_space, ptr, size);
 	ASSERT(tmp);
+	profile_heap_alloc(PROFILE_USER_HEAP, tmp);
 	return tmp;
 }
 
@@ -217,6 +227,7 @@ void * calloc(size_t num, size_t size)
 	if (user_snapshot_space) {
 		void *tmp = mspace_calloc(user_snapshot_space, num, size);
 		ASSERT(tmp);
+		profile_heap_alloc(PROFILE_USER_HEAP, tmp);
 		return tmp;
 	} else {
 		void *tmp = HandleEarlyAllocationRequest(size * num);
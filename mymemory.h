@@ -269,6 +269,25 @@ extern "C" {
 	extern void * mspace_calloc(mspace msp, size_t n_elements, size_t elem_size);
 	extern mspace create_mspace_with_base(void* base, size_t capacity, int locked);
 	extern mspace create_mspace(size_t capacity, int locked);
+	extern size_t mspace_usable_size(void *mem);
+
+	/**
+	 * @brief dlmalloc's struct mallinfo (see malloc.c), renamed so as not to
+	 * clash with the int-sized one in the system's <malloc.h>
+	 */
+	struct mspace_info {
+		size_t arena;
+		size_t ordblks;
+		size_t smblks;
+		size_t hblks;
+		size_t hblkhd;
+		size_t usmblks;
+		size_t fsmblks;
+		size_t uordblks; /* total allocated space */
+		size_t fordblks;
+		size_t keepcost;
+	};
+	extern struct mspace_info mspace_mallinfo(mspace msp);
 
 #if USE_MPROTECT_SNAPSHOT
 	extern mspace user_snapshot_space;
@@ -11,6 +11,9 @@
 #include "execution.h"
 #include "params.h"
 
+/** @brief The hash of the empty path (see NodeStack::get_path_hash()) */
+#define PATH_HASH_INIT 0xcbf29ce484222325ULL
+
 /**
  * @brief Node constructor
  *
@@ -25,14 +28,19 @@
  * parent.
  * @param nthreads The number of threads which exist at this point in the
  * execution trace.
+ * @param sched_thread The thread after which the scheduler starts its
+ * round-robin search for the next thread
  */
 Node::Node(const struct model_params *params, ModelAction *act, Node *par,
-		int nthreads, Node *prevfairness) :
+		int nthreads, Node *prevfairness, thread_id_t sched_thread) :
 	read_from_status(READ_FROM_PAST),
 	action(act),
 	params(params),
 	uninit_action(NULL),
 	parent(par),
+	depth(par ? par->depth + 1 : 0),
+	bound_count(par ? par->bound_count + par->get_bound_cost(act->get_tid()) : 0),
+	sched_thread(sched_thread),
 	num_threads(nthreads),
 	explored_children(num_threads),
 	backtrack(num_threads),
@@ -51,7 +59,9 @@ Node::Node(const struct model_params *params, ModelAction *act, Node *par,
 	relseq_break_index(0),
 	misc_index(0),
 	misc_max(0),
-	yield_data(NULL)
+	yield_data(NULL),
+	replay_rf_status(READ_FROM_NONE),
+	replay_rf_seq(0)
 {
 	ASSERT(act);
 	act->set_node(this);
@@ -265,6 +275,51 @@ bool Node::set_backtrack(thread_id_t id)
 	return true;
 }
 
+/**
+ * @brief Count the preemptions (or delays) of running a thread next, in a
+ * bounded search
+ *
+ * Both count against the scheduler's own choice, which is the next enabled
+ * thread round-robin (see Scheduler::select_next_thread()); it costs nothing,
+ * so that a bounded search explores the same executions as an unbounded one
+ * once its bound is high enough. Otherwise, switching away from the thread
+ * which took the last step while it is still enabled costs one preemption;
+ * keeping it running, or switching after it blocks, finishes or yields, is
+ * free. Running a thread costs one delay for each enabled thread that the
+ * scheduler would have chosen first.
+ *
+ * Must be called after the child of this Node has been explored, so that we
+ * know which threads were enabled.
+ *
+ * @param tid The thread to run after the action at this Node
+ * @return The preemptions (or delays) it takes; 0 if this is not a bounded
+ * search
+ */
+int Node::get_bound_cost(thread_id_t tid) const
+{
+	if (params->boundtype == BOUND_NONE)
+		return 0;
+	/* Neither the rest of an RMW nor the start of a newly created thread
+	 * is up to the scheduler (see
+	 * ModelExecution::action_select_next_thread()) */
+	if (action->is_rmwr() && action->get_tid() == tid)
+		return 0;
+	if (action->get_type() == THREAD_CREATE && action->get_thread_operand()->get_id() == tid)
+		return 0;
+
+	ASSERT(id_to_int(tid) < num_threads);
+	int delays = 0;
+	for (int i = (id_to_int(sched_thread) + 1) % num_threads; i != id_to_int(tid); i = (i + 1) % num_threads)
+		if (enabled_status(int_to_id(i)) == THREAD_ENABLED)
+			delays++;
+	if (params->boundtype == BOUND_DELAYS || delays == 0)
+		return delays;
+
+	thread_id_t last = action->get_tid();
+	return tid != last && !action->is_yield() &&
+		enabled_status(last) == THREAD_ENABLED ? 1 : 0;
+}
+
 thread_id_t Node::get_next_backtrack()
 {
 	/** @todo Find next backtrack */
@@ -414,6 +469,13 @@ read_from_type_t Node::get_read_from_status()
 {
 	if (read_from_status == READ_FROM_PAST && read_from_past.empty())
 		increment_read_from();
+	/* A replayed promise which never showed up; start from scratch */
+	if (read_from_status == READ_FROM_PROMISE && read_from_promise_idx < 0) {
+		read_from_past_idx = 0;
+		read_from_status = READ_FROM_PAST;
+		if (read_from_past.empty())
+			increment_read_from();
+	}
 	return read_from_status;
 }
 
@@ -479,6 +541,13 @@ void Node::print_read_from_past()
 void Node::add_read_from_past(const ModelAction *act)
 {
 	read_from_past.push_back(act);
+	/* Replaying a recorded choice? */
+	if (replay_rf_status == READ_FROM_PAST) {
+		if (act->get_seq_number() == replay_rf_seq)
+			read_from_past_idx = read_from_past.size() - 1;
+	} else if (replay_rf_status != READ_FROM_NONE) {
+		read_from_past_idx = read_from_past.size();
+	}
 }
 
 /**
@@ -539,6 +608,13 @@ bool Node::increment_read_from_past()
 void Node::add_read_from_promise(const ModelAction *reader)
 {
 	read_from_promises.push_back(reader);
+	/* Replaying a recorded choice? */
+	if (replay_rf_status == READ_FROM_PROMISE) {
+		if (reader->get_seq_number() == replay_rf_seq)
+			read_from_promise_idx = read_from_promises.size() - 1;
+	} else if (replay_rf_status == READ_FROM_FUTURE) {
+		read_from_promise_idx = read_from_promises.size();
+	}
 }
 
 /**
@@ -751,6 +827,246 @@ bool Node::increment_behaviors()
 	return false;
 }
 
+/**
+ * @brief Record the choices made at this Node
+ * @param choice Returns the choices
+ */
+void Node::get_choice(struct node_choice *choice) const
+{
+	get_default_choice(action->get_tid(), choice);
+	choice->read_from_status = read_from_status;
+	switch (read_from_status) {
+	case READ_FROM_PAST:
+		if (read_from_past_idx < read_from_past.size())
+			choice->rf_seq = read_from_past[read_from_past_idx]->get_seq_number();
+		break;
+	case READ_FROM_PROMISE:
+		choice->rf_seq = read_from_promises[read_from_promise_idx]->get_seq_number();
+		break;
+	case READ_FROM_FUTURE:
+		choice->fv = future_values[future_index];
+		break;
+	default:
+		break;
+	}
+	choice->resolve_promise_idx = resolve_promise_idx;
+	choice->relseq_break_index = relseq_break_index;
+	choice->misc_index = misc_index;
+}
+
+/**
+ * @brief Get the choices made at a freshly-created Node
+ * @param tid The thread which executes at the Node
+ * @param choice Returns the choices
+ */
+void Node::get_default_choice(thread_id_t tid, struct node_choice *choice)
+{
+	memset(choice, 0, sizeof(*choice));
+	choice->tid = tid;
+	choice->read_from_status = READ_FROM_PAST;
+	choice->resolve_promise_idx = -1;
+}
+
+/**
+ * @brief Force this (newly-created) Node to make a recorded set of choices
+ *
+ * The may-read-from sets are not populated until after the Node is created,
+ * so read-from choices are matched up as they are added. If the recorded
+ * choice never shows up, we fall back to the first choice.
+ *
+ * @param choice The choices to replay
+ */
+void Node::set_choice(const struct node_choice *choice)
+{
+	ASSERT(choice->tid == action->get_tid());
+	replay_rf_status = choice->read_from_status;
+	replay_rf_seq = choice->rf_seq;
+	read_from_status = choice->read_from_status;
+	if (read_from_status == READ_FROM_FUTURE) {
+		future_values.push_back(choice->fv);
+		future_index = 0;
+	}
+	resolve_promise_idx = choice->resolve_promise_idx;
+	relseq_break_index = choice->relseq_break_index;
+	misc_index = choice->misc_index;
+}
+
+/**
+ * @brief Mix a set of choices into a hash
+ *
+ * The choices identify a Node's position in the exploration tree, given the
+ * choices made at its ancestors.
+ *
+ * @param hash The hash of the choices made at the ancestors
+ * @param choice The choices to mix in
+ * @return The updated hash
+ */
+uint64_t Node::hash_choice(uint64_t hash, const struct node_choice *choice)
+{
+	uint64_t fv_id = 0;
+	if (choice->read_from_status == READ_FROM_FUTURE)
+		fv_id = choice->fv.value ^ ((uint64_t)id_to_int(choice->fv.tid) << 56);
+	uint64_t choices[] = {
+		(uint64_t)id_to_int(choice->tid),
+		(uint64_t)choice->read_from_status,
+		(uint64_t)choice->rf_seq,
+		fv_id,
+		(uint64_t)choice->resolve_promise_idx,
+		(uint64_t)choice->relseq_break_index,
+		(uint64_t)choice->misc_index,
+	};
+	/* FNV-1a */
+	for (unsigned int i = 0; i < sizeof(choices) / sizeof(choices[0]); i++) {
+		hash ^= choices[i];
+		hash *= 0x100000001b3ULL;
+	}
+	return hash;
+}
+
+/**
+ * @brief Mix the choices made at this Node into a hash
+ * @param hash The hash of the choices made at the ancestors of this Node
+ * @return The updated hash
+ */
+uint64_t Node::hash_choice(uint64_t hash) const
+{
+	struct node_choice choice;
+	get_choice(&choice);
+	return hash_choice(hash, &choice);
+}
+
+/**
+ * @brief Give away one of the threads in the backtracking set
+ *
+ * The thread is marked as explored, since someone else will explore it.
+ *
+ * @return The thread which should be explored elsewhere
+ */
+thread_id_t Node::donate_backtrack()
+{
+	thread_id_t tid = get_next_backtrack();
+	explored_children[id_to_int(tid)] = true;
+	return tid;
+}
+
+/**
+ * @brief Give away one of the unexplored behaviors of this Node
+ *
+ * We give away the last element of one of the behavior sets (misc values,
+ * reads-from past) by removing it from this Node, so that the remaining
+ * iteration order is undisturbed. Future values are never given away, since
+ * their expiration keeps changing while we explore.
+ *
+ * @param choice Returns the choices which should be explored elsewhere
+ * @return True if there was a behavior to give away
+ */
+bool Node::donate_behavior(struct node_choice *choice)
+{
+	get_choice(choice);
+	if (!misc_empty()) {
+		choice->misc_index = --misc_max;
+		return true;
+	}
+	if (read_from_status == READ_FROM_PAST && !read_from_past_empty()) {
+		choice->rf_seq = read_from_past.back()->get_seq_number();
+		choice->resolve_promise_idx = -1;
+		read_from_past.pop_back();
+		return true;
+	}
+	return false;
+}
+
+/**
+ * @brief Save the exploration state of this Node to a checkpoint
+ *
+ * The may-read-from, promise and release sequence sets are rebuilt when the
+ * path to this Node is replayed, so we only need the position within them
+ * (see get_choice()). Everything else which accumulates across executions is
+ * saved here.
+ *
+ * @param buf The checkpoint under construction
+ */
+void Node::save_state(checkpoint_buf_t *buf) const
+{
+	checkpoint_append(buf, &numBacktracks, sizeof(numBacktracks));
+	for (int i = 0; i < num_threads; i++) {
+		char flags = (explored_children[i] ? 1 : 0) | (backtrack[i] ? 2 : 0);
+		checkpoint_append(buf, &flags, sizeof(flags));
+	}
+	for (int i = 0; i < num_threads; i++)
+		checkpoint_append(buf, &fairness[i], sizeof(fairness[i]));
+
+	char has_enabled = enabled_array != NULL;
+	checkpoint_append(buf, &has_enabled, sizeof(has_enabled));
+	if (has_enabled)
+		checkpoint_append(buf, enabled_array, sizeof(*enabled_array) * num_threads);
+
+	char has_yield = yield_data != NULL;
+	checkpoint_append(buf, &has_yield, sizeof(has_yield));
+	if (has_yield)
+		checkpoint_append(buf, yield_data, sizeof(*yield_data) * num_threads * num_threads);
+
+	int num_fv = future_values.size();
+	checkpoint_append(buf, &num_fv, sizeof(num_fv));
+	for (int i = 0; i < num_fv; i++)
+		checkpoint_append(buf, &future_values[i], sizeof(future_values[i]));
+	checkpoint_append(buf, &future_index, sizeof(future_index));
+}
+
+/**
+ * @brief Restore the exploration state of this Node from a checkpoint
+ *
+ * Should be called once the path to this Node has been replayed.
+ *
+ * @param cur The read cursor for the checkpoint
+ * @return True on success; false if the checkpoint is corrupt
+ */
+bool Node::restore_state(struct checkpoint_cursor *cur)
+{
+	if (!checkpoint_take(cur, &numBacktracks, sizeof(numBacktracks)))
+		return false;
+	for (int i = 0; i < num_threads; i++) {
+		char flags;
+		if (!checkpoint_take(cur, &flags, sizeof(flags)))
+			return false;
+		explored_children[i] = flags & 1;
+		backtrack[i] = flags & 2;
+	}
+	for (int i = 0; i < num_threads; i++)
+		if (!checkpoint_take(cur, &fairness[i], sizeof(fairness[i])))
+			return false;
+
+	char has_enabled;
+	if (!checkpoint_take(cur, &has_enabled, sizeof(has_enabled)))
+		return false;
+	if (has_enabled) {
+		if (!enabled_array)
+			enabled_array = (enabled_type_t *)model_malloc(sizeof(enabled_type_t) * num_threads);
+		if (!checkpoint_take(cur, enabled_array, sizeof(*enabled_array) * num_threads))
+			return false;
+	}
+
+	char has_yield;
+	if (!checkpoint_take(cur, &has_yield, sizeof(has_yield)))
+		return false;
+	if (has_yield) {
+		if (yield_data == NULL)
+			yield_data = (int *)model_calloc(1, sizeof(int) * num_threads * num_threads);
+		if (!checkpoint_take(cur, yield_data, sizeof(*yield_data) * num_threads * num_threads))
+			return false;
+	}
+
+	int num_fv;
+	if (!checkpoint_take(cur, &num_fv, sizeof(num_fv)) || num_fv < 0)
+		return false;
+	future_values.resize(num_fv);
+	for (int i = 0; i < num_fv; i++)
+		if (!checkpoint_take(cur, &future_values[i], sizeof(future_values[i])))
+			return false;
+	return checkpoint_take(cur, &future_index, sizeof(future_index)) &&
+		future_index < num_fv;
+}
+
 NodeStack::NodeStack() :
 	node_list(),
 	head_idx(-1),
@@ -793,7 +1109,7 @@ void NodeStack::print() const
 
 /** Note: The is_enabled set contains what actions were enabled when
  *  act was chosen. */
-ModelAction * NodeStack::explore_action(ModelAction *act, enabled_type_t *is_enabled)
+ModelAction * NodeStack::explore_action(ModelAction *act, enabled_type_t *is_enabled, thread_id_t sched_thread)
 {
 	DBG();
 
@@ -814,9 +1130,12 @@ ModelAction * NodeStack::explore_action(ModelAction *act, enabled_type_t *is_ena
 	int next_threads = execution->get_num_threads();
 	if (act->get_type() == THREAD_CREATE)
 		next_threads++;
-	node_list.push_back(new Node(get_params(), act, head, next_threads, prevfairness));
+	Node *node = new Node(get_params(), act, head, next_threads, prevfairness, sched_thread);
+	node_list.push_back(node);
 	total_nodes++;
 	head_idx++;
+	if (head_idx < (int)replay_prefix.size())
+		node->set_choice(&replay_prefix[head_idx]);
 	return NULL;
 }
 
@@ -845,6 +1164,7 @@ void NodeStack::full_reset()
 		delete node_list[i];
 	node_list.clear();
 	reset_execution();
+	replay_prefix.clear();
 	total_nodes = 1;
 }
 
@@ -869,7 +1189,299 @@ Node * NodeStack::get_next() const
 	return node_list[it];
 }
 
-void NodeStack::reset_execution()
+/**
+ * @brief Hash the sequence of choices leading up to a point in the NodeStack
+ * @param depth The number of Nodes (from the bottom of the stack) to include
+ * @return A hash identifying the path to the given depth
+ */
+uint64_t NodeStack::get_path_hash(int depth) const
+{
+	uint64_t hash = PATH_HASH_INIT;
+	for (int i = 0; i < depth; i++)
+		hash = node_list[i]->hash_choice(hash);
+	return hash;
+}
+
+/**
+ * @brief Hash the paths to all the choices made in the current execution
+ * @param hashes Returns two hashes for each Node in the stack: one for the path
+ * to its thread with the default behavior (see get_backtrack_hash()), and one
+ * for the path through its actual behavior (see get_path_hash())
+ */
+void NodeStack::get_choice_hashes(ModelVector<uint64_t> *hashes) const
+{
+	uint64_t hash = PATH_HASH_INIT;
+	for (int i = 0; i <= head_idx; i++) {
+		struct node_choice choice;
+		node_list[i]->get_choice(&choice);
+		Node::get_default_choice(choice.tid, &choice);
+		hashes->push_back(Node::hash_choice(hash, &choice));
+		hash = node_list[i]->hash_choice(hash);
+		hashes->push_back(hash);
+	}
+}
+
+/**
+ * @brief Hash the path to a new thread choice in the NodeStack
+ * @param depth The depth of the Node at which the new thread will execute
+ * @param tid The new thread
+ * @return A hash identifying the new path
+ */
+uint64_t NodeStack::get_backtrack_hash(int depth, thread_id_t tid) const
+{
+	struct node_choice choice;
+	Node::get_default_choice(tid, &choice);
+	return Node::hash_choice(get_path_hash(depth), &choice);
+}
+
+/**
+ * @brief Discard the stack and start replaying a recorded path
+ *
+ * The next execution will make the recorded choices at the bottom of the
+ * stack, after which exploration continues as normal.
+ *
+ * @param path The choices to make
+ * @param len The length of the path
+ */
+void NodeStack::set_replay_prefix(const struct node_choice *path, int len)
+{
+	for (unsigned int i = 0; i < node_list.size(); i++)
+		delete node_list[i];
+	node_list.clear();
+	reset_execution();
+	replay_prefix.assign(path, path + len);
+}
+
+/**
+ * @return The choices for the next step, if we are replaying a recorded path;
+ * NULL otherwise
+ */
+const struct node_choice * NodeStack::get_replay_choice() const
+{
+	unsigned int next = head_idx + 1;
+	if (next < replay_prefix.size())
+		return &replay_prefix[next];
+	return NULL;
+}
+
+/**
+ * @brief Get the threads which a Node records as being in the sleep set
+ * @param node The Node
+ * @return A bitmask of sleeping threads (only the first 64 threads)
+ */
+static uint64_t get_sleep_mask(const Node *node)
+{
+	uint64_t mask = 0;
+	for (int i = 0; i < 64; i++)
+		if (node->enabled_status(int_to_id(i)) == THREAD_SLEEP_SET)
+			mask |= 1ULL << i;
+	return mask;
+}
+
+/**
+ * @brief Get the threads which have run (or been given away) at a Node
+ * @param node The Node
+ * @return A bitmask of explored threads (only the first 64 threads)
+ */
+static uint64_t get_explored_mask(const Node *node)
+{
+	uint64_t mask = 0;
+	for (int i = 0; i < 64 && i < node->get_num_threads(); i++)
+		if (node->has_been_explored(int_to_id(i)))
+			mask |= 1ULL << i;
+	return mask;
+}
+
+/**
+ * @brief Record the path to the Node at a given depth
+ *
+ * Each step carries the sleep set that the Node was built with, so that the
+ * replay explores its subtree just as we would have.
+ *
+ * @param depth The depth of the Node
+ * @param path Returns the path (depth + 1 entries long)
+ */
+void NodeStack::get_path(int depth, struct node_choice *path) const
+{
+	for (int j = 0; j <= depth; j++) {
+		node_list[j]->get_choice(&path[j]);
+		if (j > 0)
+			path[j].sleep_set = get_sleep_mask(node_list[j - 1]);
+	}
+}
+
+/**
+ * @brief Record the path to an unexplored thread choice in the stack
+ * @param depth The depth of the Node after which the thread will run
+ * @param tid The thread
+ * @param path Returns the path (depth + 2 entries long)
+ * @param hash Returns a hash identifying the path
+ */
+void NodeStack::get_backtrack_path(int depth, thread_id_t tid, struct node_choice *path, uint64_t *hash) const
+{
+	const Node *node = node_list[depth];
+	get_path(depth, path);
+	/* Sleep as we would have when backtracking here ourselves, after the
+	 * threads explored already */
+	uint64_t sleep = get_sleep_mask(node) | get_explored_mask(node);
+	if (id_to_int(tid) < 64)
+		sleep &= ~(1ULL << id_to_int(tid));
+	Node::get_default_choice(tid, &path[depth + 1]);
+	path[depth + 1].sleep_set = sleep;
+	*hash = get_backtrack_hash(depth + 1, tid);
+}
+
+/**
+ * @brief Record the path to an unexplored behavior in the stack
+ * @param depth The depth of the Node
+ * @param choice The behavior
+ * @param path Returns the path (depth + 1 entries long)
+ * @param hash Returns a hash identifying the path
+ */
+void NodeStack::get_behavior_path(int depth, const struct node_choice *choice, struct node_choice *path, uint64_t *hash) const
+{
+	get_path(depth, path);
+	uint64_t sleep = path[depth].sleep_set;
+	path[depth] = *choice;
+	path[depth].sleep_set = sleep;
+	*hash = Node::hash_choice(get_path_hash(depth), &path[depth]);
+}
+
+/**
+ * @brief Give away the shallowest unexplored alternative in the stack
+ *
+ * The alternative is removed from this NodeStack (a thread is marked as
+ * explored; see Node::donate_backtrack()), and described instead as a path
+ * which can be replayed by someone else (see set_replay_prefix).
+ *
+ * @param rootdepth The depth of the root of the subtree we own, or -1 for the
+ * whole tree; alternatives at or above it are not ours to give away
+ * @param maxdepth Only consider Nodes shallower than this depth
+ * @param path Returns the path to the alternative (at least maxdepth + 1
+ * entries long)
+ * @param hash Returns a hash identifying the path
+ * @return The length of the path, or 0 if there was nothing to give away
+ */
+int NodeStack::donate_alternative(int rootdepth, int maxdepth, struct node_choice *path, uint64_t *hash)
+{
+	for (int i = rootdepth < 0 ? 0 : rootdepth; i < maxdepth && i < (int)node_list.size(); i++) {
+		Node *node = node_list[i];
+		if (!node->backtrack_empty()) {
+			get_backtrack_path(i, node->donate_backtrack(), path, hash);
+			return i + 2;
+		}
+		struct node_choice choice;
+		if (i > rootdepth && node->donate_behavior(&choice)) {
+			get_behavior_path(i, &choice, path, hash);
+			return i + 1;
+		}
+	}
+	return 0;
+}
+
+/**
+ * @brief Save the NodeStack to a checkpoint
+ *
+ * Each Node is saved as the choices made at it (which are replayed on resume)
+ * followed by its exploration state.
+ *
+ * @param buf The checkpoint under construction
+ */
+void NodeStack::save_checkpoint(checkpoint_buf_t *buf) const
+{
+	int num_nodes = head_idx + 1;
+	checkpoint_append(buf, &num_nodes, sizeof(num_nodes));
+	for (int i = 0; i < num_nodes; i++) {
+		struct node_choice choice;
+		node_list[i]->get_choice(&choice);
+		/* Replay with the same sleep set that the Node was built with */
+		if (i > 0)
+			choice.sleep_set = get_sleep_mask(node_list[i - 1]);
+		checkpoint_append(buf, &choice, sizeof(choice));
+
+		/* Leave room for the size of the state, so it can be skipped */
+		unsigned int len_pos = buf->size();
+		unsigned int len = 0;
+		checkpoint_append(buf, &len, sizeof(len));
+		node_list[i]->save_state(buf);
+		len = buf->size() - len_pos - sizeof(len);
+		memcpy(&(*buf)[len_pos], &len, sizeof(len));
+	}
+}
+
+/**
+ * @brief Start resuming from a checkpoint
+ *
+ * Discards the stack and arranges for the next execution to replay the path
+ * saved in the checkpoint. Call restore_checkpoint() with the same cursor once
+ * that execution is done.
+ *
+ * @param cur The read cursor for the checkpoint; left unchanged
+ * @return True on success; false if the checkpoint is corrupt
+ */
+bool NodeStack::load_checkpoint(struct checkpoint_cursor *cur)
+{
+	struct checkpoint_cursor pos = *cur;
+	int num_nodes;
+	if (!checkpoint_take(&pos, &num_nodes, sizeof(num_nodes)) || num_nodes < 0)
+		return false;
+
+	ModelVector<struct node_choice> path(num_nodes);
+	for (int i = 0; i < num_nodes; i++) {
+		unsigned int len;
+		if (!checkpoint_take(&pos, &path[i], sizeof(path[i])) ||
+				!checkpoint_take(&pos, &len, sizeof(len)) ||
+				!checkpoint_skip(&pos, len))
+			return false;
+	}
+	set_replay_prefix(path.empty() ? NULL : &path[0], num_nodes);
+	return true;
+}
+
+/**
+ * @brief Finish resuming from a checkpoint
+ *
+ * Lays the saved exploration state over the Nodes created by replaying the
+ * checkpoint's path (see load_checkpoint()).
+ *
+ * @param cur The read cursor for the checkpoint
+ * @return True on success; false if the checkpoint is corrupt, or if the
+ * replay did not reproduce the saved path
+ */
+bool NodeStack::restore_checkpoint(struct checkpoint_cursor *cur)
+{
+	int num_nodes;
+	if (!checkpoint_take(cur, &num_nodes, sizeof(num_nodes)) ||
+			num_nodes != head_idx + 1)
+		return false;
+
+	for (int i = 0; i < num_nodes; i++) {
+		Node *node = node_list[i];
+		struct node_choice saved, replayed;
+		unsigned int len;
+		if (!checkpoint_take(cur, &saved, sizeof(saved)) ||
+				!checkpoint_take(cur, &len, sizeof(len)))
+			return false;
+		node->get_choice(&replayed);
+		if (Node::hash_choice(0, &saved) != Node::hash_choice(0, &replayed))
+			return false;
+
+		const char *start = cur->pos;
+		if (!node->restore_state(cur) || cur->pos != start + len)
+			return false;
+	}
+	return true;
+}
+
+/**
+ * @brief Prepare to replay the current path for a new execution
+ * @param numsteps The number of steps which have already been taken (i.e.,
+ * restored from a snapshot); the replay picks up after them
+ */
+void NodeStack::reset_execution(int numsteps)
 {
-	head_idx = -1;
+	ASSERT(numsteps <= (int)node_list.size());
+	head_idx = numsteps - 1;
+	/* A recorded path is only replayed once */
+	replay_prefix.clear();
 }
@@ -12,6 +12,7 @@
 #include "schedule.h"
 #include "promise.h"
 #include "stl-model.h"
+#include "checkpoint.h"
 
 class ModelAction;
 class Thread;
@@ -36,6 +37,33 @@ typedef enum {
 	READ_FROM_NONE, /**< @brief A NULL state, which should not be reached */
 } read_from_type_t;
 
+/**
+ * @brief A serializable record of the choices made at a Node
+ *
+ * Identifies a Node's position in the exploration tree, relative to its
+ * parent, without referring to any pointers; used for handing subtrees
+ * between parallel workers and for replaying a path in a fresh NodeStack.
+ * Read-from choices are identified by content (sequence numbers, future
+ * values) rather than by index, since the may-read-from sets can be ordered
+ * differently depending on the exploration history.
+ */
+struct node_choice {
+	thread_id_t tid;
+	read_from_type_t read_from_status;
+	/** @brief Sequence number of the write (READ_FROM_PAST) or the
+	 *  promise's reader (READ_FROM_PROMISE) */
+	modelclock_t rf_seq;
+	/** @brief The future value (READ_FROM_FUTURE only) */
+	struct future_value fv;
+	int resolve_promise_idx;
+	int relseq_break_index;
+	int misc_index;
+	/** @brief Threads to put to sleep before taking this step, as a
+	 *  bitmask (threads beyond the first 64 never sleep); not part of
+	 *  the Node's identity */
+	uint64_t sleep_set;
+};
+
 #define YIELD_E 1
 #define YIELD_D 2
 #define YIELD_S 4
@@ -55,7 +83,7 @@ typedef enum {
 class Node {
 public:
 	Node(const struct model_params *params, ModelAction *act, Node *par,
-			int nthreads, Node *prevfairness);
+			int nthreads, Node *prevfairness, thread_id_t sched_thread);
 	~Node();
 	/* return true = thread choice has already been explored */
 	bool has_been_explored(thread_id_t tid) const;
@@ -79,6 +107,12 @@ public:
 	void update_yield(Scheduler *);
 	bool has_priority_over(thread_id_t tid, thread_id_t tid2) const;
 	int get_num_threads() const { return num_threads; }
+	/** @return the position of this Node in the NodeStack */
+	int get_depth() const { return depth; }
+	/** @return the preemptions (or delays) along the path up to, and
+	 *  including, the action at this Node */
+	int get_bound_count() const { return bound_count; }
+	int get_bound_cost(thread_id_t tid) const;
 	/** @return the parent Node to this Node; that is, the action that
 	 * occurred previously in the stack. */
 	Node * get_parent() const { return parent; }
@@ -122,6 +156,17 @@ public:
 
 	bool increment_behaviors();
 
+	void get_choice(struct node_choice *choice) const;
+	void set_choice(const struct node_choice *choice);
+	static void get_default_choice(thread_id_t tid, struct node_choice *choice);
+	static uint64_t hash_choice(uint64_t hash, const struct node_choice *choice);
+	uint64_t hash_choice(uint64_t hash) const;
+	thread_id_t donate_backtrack();
+	bool donate_behavior(struct node_choice *choice);
+
+	void save_state(checkpoint_buf_t *buf) const;
+	bool restore_state(struct checkpoint_cursor *cur);
+
 	void print() const;
 
 	MEMALLOC
@@ -145,6 +190,13 @@ private:
 	ModelAction *uninit_action;
 
 	Node * const parent;
+	const int depth;
+	/** @brief The number of preemptions (or delays) it took to get here,
+	 *  in a bounded search */
+	const int bound_count;
+	/** @brief The thread after which the scheduler starts its round-robin
+	 *  search for the next thread (see Scheduler::select_next_thread()) */
+	const thread_id_t sched_thread;
 	const int num_threads;
 	ModelVector<bool> explored_children;
 	ModelVector<bool> backtrack;
@@ -174,6 +226,11 @@ private:
 	int misc_index;
 	int misc_max;
 	int * yield_data;
+
+	/** @brief The read-from choice being replayed at this Node, if any
+	 *  (READ_FROM_NONE otherwise) */
+	read_from_type_t replay_rf_status;
+	modelclock_t replay_rf_seq;
 };
 
 typedef ModelVector<Node *> node_list_t;
@@ -193,13 +250,26 @@ public:
 
 	void register_engine(const ModelExecution *exec);
 
-	ModelAction * explore_action(ModelAction *act, enabled_type_t * is_enabled);
+	ModelAction * explore_action(ModelAction *act, enabled_type_t * is_enabled, thread_id_t sched_thread);
 	Node * get_head() const;
 	Node * get_next() const;
-	void reset_execution();
+	void reset_execution(int numsteps = 0);
 	void pop_restofstack(int numAhead);
 	void full_reset();
 	int get_total_nodes() { return total_nodes; }
+	uint64_t get_path_hash(int depth) const;
+	uint64_t get_backtrack_hash(int depth, thread_id_t tid) const;
+	void get_choice_hashes(ModelVector<uint64_t> *hashes) const;
+
+	void set_replay_prefix(const struct node_choice *path, int len);
+	const struct node_choice * get_replay_choice() const;
+	void get_backtrack_path(int depth, thread_id_t tid, struct node_choice *path, uint64_t *hash) const;
+	void get_behavior_path(int depth, const struct node_choice *choice, struct node_choice *path, uint64_t *hash) const;
+	int donate_alternative(int rootdepth, int maxdepth, struct node_choice *path, uint64_t *hash);
+
+	void save_checkpoint(checkpoint_buf_t *buf) const;
+	bool load_checkpoint(struct checkpoint_cursor *cur);
+	bool restore_checkpoint(struct checkpoint_cursor *cur);
 
 	void print() const;
 
@@ -208,6 +278,7 @@ private:
 	node_list_t node_list;
 
 	const struct model_params * get_params() const;
+	void get_path(int depth, struct node_choice *path) const;
 
 	/** @brief The model-checker execution object */
 	const ModelExecution *execution;
@@ -221,6 +292,10 @@ private:
 	int head_idx;
 
 	int total_nodes;
+
+	/** @brief Choices to force at the bottom of the stack, when replaying a
+	 *  path handed to us by another worker or saved in a checkpoint */
+	ModelVector<struct node_choice> replay_prefix;
 };
 
 #endif /* __NODESTACK_H__ */
@@ -5,16 +5,24 @@
 #ifndef __OUTPUT_H__
 #define __OUTPUT_H__
 
+#include <stddef.h>
+
 #include "config.h"
 
 #ifdef CONFIG_DEBUG
 static inline void redirect_output() { }
 static inline void clear_program_output() { }
 static inline void print_program_output() { }
+static inline void reopen_program_output() { }
+static inline size_t buffer_program_output() { return 0; }
+static inline void rewind_program_output(size_t len) { }
 #else
 void redirect_output();
 void clear_program_output();
 void print_program_output();
+void reopen_program_output();
+size_t buffer_program_output();
+void rewind_program_output(size_t len);
 #endif /* ! CONFIG_DEBUG */
 
 #endif /* __OUTPUT_H__ */
@@ -0,0 +1,412 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <unistd.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+
+#include "parallel.h"
+#include "model.h"
+#include "common.h"
+#include "output.h"
+#include "statsjson.h"
+
+/** @brief Per-worker record, kept in the inter-process shared region */
+struct parallel_worker {
+	pid_t pid;
+	/** @brief The worker has published its stats */
+	volatile bool reported;
+	struct execution_stats stats;
+	int total_nodes;
+};
+
+/** @brief States of a donation slot */
+enum donation_state {
+	DONATION_EMPTY,
+	DONATION_WRITING,
+	DONATION_FULL,
+	DONATION_READING
+};
+
+/** @brief A subtree handed from a busy worker to an idle one */
+struct parallel_donation {
+	volatile int state;
+	int len;
+	struct node_choice path[PARALLEL_MAX_PATH];
+};
+
+/** @brief Inter-process shared state for parallel exploration */
+struct parallel_state {
+	unsigned int num_workers;
+	/** @brief Number of workers waiting for (or done with) work */
+	volatile unsigned int num_idle;
+	/** @brief Number of donations not yet picked up */
+	volatile unsigned int num_donations;
+	struct parallel_worker workers[PARALLEL_MAX_WORKERS];
+	struct parallel_donation donations[PARALLEL_MAX_WORKERS];
+	/** @brief Open-addressed table of claimed subtree path hashes; zero
+	 *  denotes an empty slot */
+	volatile uint64_t claims[PARALLEL_CLAIM_TABLE_SIZE];
+};
+
+static struct parallel_state *par_state = NULL;
+
+/** @brief Our worker ID, or -1 for the (non-exploring) parent process */
+static int worker_id = -1;
+
+/** @brief Are we counted in parallel_state::num_idle? */
+static bool counted_idle = false;
+
+/**
+ * @brief Per-worker files capturing the model-checker output of each worker
+ *
+ * Printed by the parent, one worker at a time, once all workers are done, so
+ * that the bug reports and traces of different workers don't interleave.
+ */
+static int output_fds[PARALLEL_MAX_WORKERS];
+
+/** @brief Per-worker files capturing the trace-analysis statistics */
+static int plugin_stats_fds[PARALLEL_MAX_WORKERS];
+
+static void create_shared_state()
+{
+	void *base = mmap(NULL, sizeof(struct parallel_state), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANON, -1, 0);
+	if (base == MAP_FAILED) {
+		perror("mmap");
+		exit(EXIT_FAILURE);
+	}
+	/* Anonymous mappings are zero-filled */
+	par_state = (struct parallel_state *)base;
+}
+
+/** @return A file descriptor for a new, anonymous temporary file */
+static int create_capture_file()
+{
+	const char *dir = getenv("TMPDIR");
+	char name[PATH_MAX];
+	snprintf(name, sizeof(name), "%s/cdschecker-XXXXXX", dir ? dir : "/tmp");
+	int fd = mkstemp(name);
+	if (fd < 0) {
+		perror("mkstemp");
+		exit(EXIT_FAILURE);
+	}
+	unlink(name);
+	return fd;
+}
+
+/**
+ * @brief Read back the whole contents of a capture file
+ * @param fd The capture file
+ * @param len Returns the length of the contents
+ * @return The contents (NUL-terminated, to be freed by the caller), or NULL if
+ * the file is empty
+ */
+static char * read_capture_file(int fd, size_t *len)
+{
+	off_t size = lseek(fd, 0, SEEK_END);
+	if (size <= 0)
+		return NULL;
+	char *buf = (char *)model_malloc(size + 1);
+	*len = 0;
+	while (*len < (size_t)size) {
+		ssize_t ret = pread(fd, buf + *len, size - *len, *len);
+		if (ret <= 0)
+			break;
+		*len += ret;
+	}
+	buf[*len] = '\0';
+	return buf;
+}
+
+/** @brief Print the output captured from each worker, in worker ID order */
+static void print_worker_output()
+{
+	for (unsigned int i = 0; i < par_state->num_workers; i++) {
+		size_t len;
+		char *buf = read_capture_file(output_fds[i], &len);
+		if (!buf)
+			continue;
+		model_print("******* Parallel worker %u output: *******\n", i);
+		for (size_t pos = 0; pos < len; ) {
+			ssize_t res = write(model_out, buf + pos, len - pos);
+			if (res < 0) {
+				perror("write");
+				exit(EXIT_FAILURE);
+			}
+			pos += res;
+		}
+		model_free(buf);
+	}
+}
+
+/**
+ * @brief Fork the worker processes for parallel exploration
+ *
+ * Must be called after the initial snapshot has been recorded, so that each
+ * worker inherits a private, consistent copy of the snapshotted heaps.
+ *
+ * @param num_workers The number of worker processes to launch
+ * @return True in a worker process (which should proceed with exploration);
+ * false in the parent, once all workers have exited
+ */
+bool parallel_start_workers(unsigned int num_workers)
+{
+	if (num_workers > PARALLEL_MAX_WORKERS) {
+		model_print("Limiting parallel exploration to %d workers\n", PARALLEL_MAX_WORKERS);
+		num_workers = PARALLEL_MAX_WORKERS;
+	}
+
+	create_shared_state();
+	par_state->num_workers = num_workers;
+
+	for (unsigned int i = 0; i < num_workers; i++) {
+		output_fds[i] = create_capture_file();
+		plugin_stats_fds[i] = create_capture_file();
+	}
+
+	for (unsigned int i = 0; i < num_workers; i++) {
+		pid_t pid = fork();
+		if (pid < 0) {
+			perror("fork");
+			exit(EXIT_FAILURE);
+		}
+		if (pid == 0) {
+			worker_id = i;
+			/* Don't mix our program output with the other workers' */
+			reopen_program_output();
+			/* ...nor our own output, which the parent prints */
+			if (dup2(output_fds[i], model_out) < 0) {
+				perror("dup2");
+				exit(EXIT_FAILURE);
+			}
+			return true;
+		}
+		par_state->workers[i].pid = pid;
+	}
+
+	for (unsigned int remaining = num_workers; remaining > 0; ) {
+		int status;
+		pid_t pid = waitpid(-1, &status, 0);
+		if (pid < 0) {
+			if (errno == EINTR)
+				continue;
+			perror("waitpid");
+			exit(EXIT_FAILURE);
+		}
+		for (unsigned int i = 0; i < num_workers; i++) {
+			struct parallel_worker *w = &par_state->workers[i];
+			if (w->pid != pid)
+				continue;
+			if (!WIFEXITED(status) || WEXITSTATUS(status) != EXIT_SUCCESS)
+				model_print("Parallel worker %u exited abnormally\n", i);
+			/* Don't leave the others waiting on it */
+			if (!w->reported)
+				__sync_fetch_and_add(&par_state->num_idle, 1);
+			remaining--;
+		}
+	}
+	print_worker_output();
+	return false;
+}
+
+/** @return True if we are a worker process in parallel exploration mode */
+bool parallel_is_worker()
+{
+	return worker_id >= 0;
+}
+
+/** @return The ID of this worker process */
+unsigned int parallel_worker_id()
+{
+	ASSERT(parallel_is_worker());
+	return worker_id;
+}
+
+/**
+ * @brief Attempt to claim the subtree rooted at a divergence point
+ *
+ * @param path_hash A hash identifying the sequence of choices which leads to
+ * the root of the subtree
+ * @return True if the subtree is ours to explore; false if another worker
+ * already claimed it
+ */
+bool parallel_claim_subtree(uint64_t path_hash)
+{
+	/* Zero marks an empty slot */
+	if (path_hash == 0)
+		path_hash = 1;
+
+	unsigned int mask = PARALLEL_CLAIM_TABLE_SIZE - 1;
+	unsigned int idx = (unsigned int)(path_hash ^ (path_hash >> 32)) & mask;
+	for (unsigned int probes = 0; probes < PARALLEL_CLAIM_TABLE_SIZE; probes++) {
+		uint64_t old = __sync_val_compare_and_swap(&par_state->claims[idx], (uint64_t)0, path_hash);
+		if (old == 0)
+			return true;
+		if (old == path_hash)
+			return false;
+		idx = (idx + 1) & mask;
+	}
+	/* Table full: exploring twice is better than never */
+	return true;
+}
+
+/** @return True if some worker is idle and waiting for a donation */
+bool parallel_want_donation()
+{
+	return par_state->num_donations < par_state->num_idle;
+}
+
+/**
+ * @brief Hand a subtree to an idle worker
+ *
+ * The subtree should already have been claimed (on behalf of the idle
+ * worker) with parallel_claim_subtree().
+ *
+ * @param path The path to the root of the subtree
+ * @param len The length of the path
+ */
+void parallel_donate(const struct node_choice *path, int len)
+{
+	ASSERT(len <= PARALLEL_MAX_PATH);
+	for (unsigned int i = 0; ; i = (i + 1) % par_state->num_workers) {
+		struct parallel_donation *d = &par_state->donations[i];
+		if (!__sync_bool_compare_and_swap(&d->state, DONATION_EMPTY, DONATION_WRITING))
+			continue;
+		memcpy(d->path, path, sizeof(*path) * len);
+		d->len = len;
+		__sync_fetch_and_add(&par_state->num_donations, 1);
+		__sync_synchronize();
+		d->state = DONATION_FULL;
+		return;
+	}
+}
+
+/** @return True if any donation is still in flight */
+static bool have_pending_donations()
+{
+	for (unsigned int i = 0; i < par_state->num_workers; i++)
+		if (par_state->donations[i].state != DONATION_EMPTY)
+			return true;
+	return false;
+}
+
+/**
+ * @brief Wait for a subtree donated by another worker
+ *
+ * We are done once every worker is idle and no donations are in flight:
+ * busy workers are the only source of donations.
+ *
+ * @param path Returns the path to the root of the subtree; must have room for
+ * PARALLEL_MAX_PATH entries
+ * @return The length of the path, or 0 if all work is done
+ */
+int parallel_steal(struct node_choice *path)
+{
+	if (!counted_idle) {
+		counted_idle = true;
+		__sync_fetch_and_add(&par_state->num_idle, 1);
+	}
+
+	while (true) {
+		for (unsigned int i = 0; i < par_state->num_workers; i++) {
+			struct parallel_donation *d = &par_state->donations[i];
+			if (!__sync_bool_compare_and_swap(&d->state, DONATION_FULL, DONATION_READING))
+				continue;
+			int len = d->len;
+			memcpy(path, d->path, sizeof(*path) * len);
+			__sync_fetch_and_sub(&par_state->num_donations, 1);
+			/* Become busy before releasing the slot, so nobody
+			 * sees an all-idle state in between */
+			__sync_fetch_and_sub(&par_state->num_idle, 1);
+			counted_idle = false;
+			__sync_synchronize();
+			d->state = DONATION_EMPTY;
+			return len;
+		}
+		if (par_state->num_idle == par_state->num_workers && !have_pending_donations())
+			return 0;
+		sched_yield();
+	}
+}
+
+/**
+ * @brief Publish a worker's cumulative results to the parent process
+ * @param stats The worker's execution stats
+ * @param total_nodes The number of NodeStack nodes created by the worker
+ */
+void parallel_report_stats(const struct execution_stats *stats, int total_nodes)
+{
+	/* We won't take part in any more work sharing */
+	if (!counted_idle) {
+		counted_idle = true;
+		__sync_fetch_and_add(&par_state->num_idle, 1);
+	}
+
+	struct parallel_worker *w = &par_state->workers[parallel_worker_id()];
+	w->stats = *stats;
+	w->total_nodes = total_nodes;
+	__sync_synchronize();
+	w->reported = true;
+}
+
+/**
+ * @brief Merge the results of all workers; called from the parent process
+ * @param stats Returns the summed execution stats
+ * @param total_nodes Returns the summed number of NodeStack nodes
+ */
+void parallel_collect_stats(struct execution_stats *stats, int *total_nodes)
+{
+	memset(stats, 0, sizeof(*stats));
+	*total_nodes = 0;
+	for (unsigned int i = 0; i < par_state->num_workers; i++) {
+		struct parallel_worker *w = &par_state->workers[i];
+		if (!w->reported)
+			continue;
+		stats->num_total += w->stats.num_total;
+		stats->num_infeasible += w->stats.num_infeasible;
+		stats->num_buggy_executions += w->stats.num_buggy_executions;
+		stats->num_complete += w->stats.num_complete;
+		stats->num_redundant += w->stats.num_redundant;
+		for (int j = 0; j < NUM_BUG_TYPES; j++)
+			stats->num_bugs[j] += w->stats.num_bugs[j];
+		*total_nodes += w->total_nodes;
+	}
+}
+
+/**
+ * @return The file to which this worker should write the statistics of its
+ * trace analyses (as a JSON document), for the parent to export
+ */
+int parallel_plugin_stats_fd()
+{
+	return plugin_stats_fds[parallel_worker_id()];
+}
+
+/**
+ * @brief Export the trace-analysis statistics of all workers; called from the
+ * parent process
+ *
+ * Each worker's statistics are exported as an object named after it, since
+ * the statistics of an arbitrary plugin cannot be combined.
+ *
+ * @param json The JSON document under construction
+ */
+void parallel_export_plugin_stats(struct stats_json *json)
+{
+	for (unsigned int i = 0; i < par_state->num_workers; i++) {
+		size_t len;
+		char *buf = read_capture_file(plugin_stats_fds[i], &len);
+		if (!buf)
+			continue;
+		/* Drop the document's trailing newline */
+		while (len > 0 && buf[len - 1] == '\n')
+			buf[--len] = '\0';
+		char key[32];
+		snprintf(key, sizeof(key), "worker_%u", i);
+		stats_json_raw(json, key, buf);
+		model_free(buf);
+	}
+}
@@ -0,0 +1,44 @@
+/** @file parallel.h
+ *  @brief Multi-process parallel exploration of the backtracking tree.
+ *
+ * In parallel mode, the model checker forks a set of worker processes which
+ * each own a private copy of the snapshotting heap and NodeStack. Workers all
+ * walk the same deterministic exploration order, but every divergence point
+ * within the shallow part of the tree (see model_params.splitdepth) is a
+ * "claim point": only the first worker to claim the subtree rooted there
+ * explores it. The others run a single, uncounted execution into the subtree
+ * (so that they observe the same backtracking points in the shallow part of
+ * the tree) and then prune it.
+ *
+ * A worker which runs out of work waits for a busy worker to donate one of
+ * its unexplored alternatives (see NodeStack::donate_alternative), which it
+ * then replays from scratch and explores.
+ *
+ * Each worker's own output (bug reports, execution traces, trace-analysis
+ * results) goes to a private file, which the parent prints as one block once
+ * all workers are done.
+ */
+
+#ifndef __PARALLEL_H__
+#define __PARALLEL_H__
+
+#include <inttypes.h>
+
+#include "nodestack.h"
+
+struct execution_stats;
+struct stats_json;
+
+bool parallel_start_workers(unsigned int num_workers);
+bool parallel_is_worker();
+unsigned int parallel_worker_id();
+bool parallel_claim_subtree(uint64_t path_hash);
+bool parallel_want_donation();
+void parallel_donate(const struct node_choice *path, int len);
+int parallel_steal(struct node_choice *path);
+void parallel_report_stats(const struct execution_stats *stats, int total_nodes);
+void parallel_collect_stats(struct execution_stats *stats, int *total_nodes);
+int parallel_plugin_stats_fd();
+void parallel_export_plugin_stats(struct stats_json *json);
+
+#endif /* __PARALLEL_H__ */
@@ -1,6 +1,17 @@
 #ifndef __PARAMS_H__
 #define __PARAMS_H__
 
+#include <stddef.h>
+
+/** @brief What a bounded search counts, along each execution */
+enum bound_type {
+	BOUND_NONE,		/**< @brief No bounded search */
+	BOUND_PREEMPTIONS,	/**< @brief Choices other than the round-robin
+				 *  scheduler's own */
+	BOUND_DELAYS		/**< @brief Threads skipped over, relative to
+				 *  the round-robin scheduler */
+};
+
 /**
  * Model checker parameter structure. Holds run-time configuration options for
  * the model checker.
@@ -25,6 +36,51 @@ struct model_params {
 	 *  value */
 	unsigned int expireslop;
 
+	/** @brief Number of worker processes for parallel exploration (1 =
+	 *  serial) */
+	unsigned int jobs;
+
+	/** @brief In parallel mode, divergence points shallower than this
+	 *  depth are divided up between the workers */
+	unsigned int splitdepth;
+
+	/** @brief File to save checkpoints to (NULL = no checkpoints) */
+	const char *checkpointfile;
+
+	/** @brief Save a checkpoint every this many executions */
+	unsigned int checkpointinterval;
+
+	/** @brief Checkpoint to resume from (NULL = start from scratch) */
+	const char *resumefile;
+
+	/** @brief Record a mid-execution snapshot every this many steps, so
+	 *  that later executions need not replay their prefix from the start
+	 *  (0 = always replay from the start) */
+	unsigned int snapshotinterval;
+
+	/** @brief Profile the model checker, and print a breakdown of where
+	 *  the time went at exit */
+	bool profile;
+
+	/** @brief File to export the run statistics to, as JSON (NULL = no
+	 *  export) */
+	const char *statsjsonfile;
+
+	/** @brief Size of each user thread's stack, in bytes (a multiple of
+	 *  the page size) */
+	size_t stacksize;
+
+	/** @brief Let a user thread take the steps which no other thread can
+	 *  observe by itself, without a scheduling point */
+	bool runtovisible;
+
+	/** @brief Search the executions with at most 0, then 1, 2, ... up to
+	 *  maxbound preemptions (or delays), rather than exhaustively */
+	enum bound_type boundtype;
+
+	/** @brief The largest bound for a bounded search to try */
+	unsigned int maxbound;
+
 	/** @brief Verbosity (0 = quiet; 1 = noisy; 2 = noisier) */
 	int verbose;
 
@@ -0,0 +1,137 @@
+#include <time.h>
+#include <sys/resource.h>
+
+#include "profile.h"
+#include "common.h"
+#include "mymemory.h"
+
+/** @brief Is the profiler enabled? */
+bool profile_enabled = false;
+
+uint64_t profile_switch_start;
+
+/** @brief Cumulative statistics for one phase */
+struct profile_counter {
+	uint64_t calls;
+	uint64_t nanoseconds;
+};
+
+static struct profile_counter counters[NUM_PROFILE_PHASES];
+
+/** @brief The time at which profiling started */
+static uint64_t profile_start;
+
+/** @brief The peak number of bytes in use on each snapshotting heap */
+static int64_t peak_bytes[NUM_PROFILE_HEAPS];
+
+/**
+ * @brief The number of bytes currently in use on each snapshotting heap
+ *
+ * This lives on the snapshotting heap itself, so that rolling back the heap
+ * also rolls back its usage. It starts from the usage at profile_init(), so
+ * that freeing a block allocated before then cannot drive it negative.
+ */
+static int64_t *live_bytes;
+
+static const char * const phase_names[NUM_PROFILE_PHASES] = {
+	"take_step",
+	"check_current_action",
+	"build_may_read_from",
+	"r_modification_order",
+	"w_modification_order",
+	"release_seq_heads",
+	"CycleGraph::checkReachable",
+	"snapshot rollback",
+	"context switch",
+	"race check",
+};
+
+static const char * const heap_names[NUM_PROFILE_HEAPS] = {
+	"model checker",
+	"user program",
+};
+
+/**
+ * @brief Start profiling
+ *
+ * Must be called before the initial snapshot is recorded.
+ */
+void profile_init()
+{
+	live_bytes = (int64_t *)snapshot_calloc(NUM_PROFILE_HEAPS, sizeof(*live_bytes));
+	live_bytes[PROFILE_MODEL_HEAP] = mspace_mallinfo(model_snapshot_space).uordblks;
+#if USE_MPROTECT_SNAPSHOT
+	if (user_snapshot_space)
+		live_bytes[PROFILE_USER_HEAP] = mspace_mallinfo(user_snapshot_space).uordblks;
+#endif
+	for (int i = 0; i < NUM_PROFILE_HEAPS; i++)
+		peak_bytes[i] = live_bytes[i];
+	profile_start = profile_now();
+	profile_enabled = true;
+}
+
+/** @return The current time, in nanoseconds */
+uint64_t profile_now()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/**
+ * @brief Account for one call to a phase
+ * @param phase The phase
+ * @param start The time at which the call began
+ */
+void profile_add(enum profile_phase phase, uint64_t start)
+{
+	counters[phase].calls++;
+	counters[phase].nanoseconds += profile_now() - start;
+}
+
+/**
+ * @brief Account for a block being allocated on, or freed from, a
+ * snapshotting heap
+ * @param heap The heap
+ * @param ptr The block
+ * @param alloc True if the block was just allocated; false if it is about to
+ * be freed
+ */
+void profile_heap_change(enum profile_heap heap, void *ptr, bool alloc)
+{
+	int64_t size = mspace_usable_size(ptr);
+	if (!alloc) {
+		live_bytes[heap] -= size;
+		return;
+	}
+	live_bytes[heap] += size;
+	if (live_bytes[heap] > peak_bytes[heap])
+		peak_bytes[heap] = live_bytes[heap];
+}
+
+/** @brief Print the breakdown of where the time (and memory) went */
+void profile_print()
+{
+	if (!profile_enabled)
+		return;
+
+	uint64_t total = profile_now() - profile_start;
+	model_print("******* Profile (inclusive times): *******\n");
+	model_print("%-28s %12s %12s %7s %10s\n", "Phase", "Calls", "Time (ms)", "% total", "ns/call");
+	for (int i = 0; i < NUM_PROFILE_PHASES; i++) {
+		const struct profile_counter *c = &counters[i];
+		model_print("%-28s %12llu %12.3f %6.1f%% %10.0f\n", phase_names[i],
+				(unsigned long long)c->calls,
+				c->nanoseconds / 1e6,
+				total ? 100.0 * c->nanoseconds / total : 0.0,
+				c->calls ? (double)c->nanoseconds / c->calls : 0.0);
+	}
+	model_print("%-28s %12s %12.3f\n", "total", "", total / 1e6);
+
+	for (int i = 0; i < NUM_PROFILE_HEAPS; i++)
+		model_print("Peak snapshotting heap usage (%s): %lld KB\n",
+				heap_names[i], (long long)(peak_bytes[i] / 1024));
+	struct rusage usage;
+	if (getrusage(RUSAGE_SELF, &usage) == 0)
+		model_print("Peak resident set size: %ld KB\n", usage.ru_maxrss);
+}
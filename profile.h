@@ -0,0 +1,102 @@
+/** @file profile.h
+ *  @brief Built-in profiler for the model checker's own work.
+ *
+ * When enabled (with -P), the profiler accumulates the time spent in, and the
+ * number of calls to, each of the main phases of exploration, along with the
+ * peak usage of the snapshotting heaps, and prints a breakdown at exit.
+ *
+ * Phase times are inclusive: a phase which runs inside another (e.g.,
+ * checkReachable inside r_modification_order) counts towards both. When
+ * profiling is disabled, each probe costs a test of a global flag.
+ */
+
+#ifndef __PROFILE_H__
+#define __PROFILE_H__
+
+#include <inttypes.h>
+#include <stddef.h>
+
+/** @brief The phases of exploration which the profiler times */
+enum profile_phase {
+	PROFILE_TAKE_STEP,
+	PROFILE_CHECK_CURRENT_ACTION,
+	PROFILE_BUILD_MAY_READ_FROM,
+	PROFILE_R_MODIFICATION_ORDER,
+	PROFILE_W_MODIFICATION_ORDER,
+	PROFILE_RELEASE_SEQ_HEADS,
+	PROFILE_CHECK_REACHABLE,
+	PROFILE_ROLLBACK,
+	PROFILE_CONTEXT_SWITCH,
+	PROFILE_RACE_CHECK,
+	NUM_PROFILE_PHASES
+};
+
+/** @brief The snapshotting heaps whose usage the profiler tracks */
+enum profile_heap {
+	PROFILE_MODEL_HEAP,
+	PROFILE_USER_HEAP,
+	NUM_PROFILE_HEAPS
+};
+
+extern bool profile_enabled;
+
+void profile_init();
+void profile_print();
+uint64_t profile_now();
+void profile_add(enum profile_phase phase, uint64_t start);
+void profile_heap_change(enum profile_heap heap, void *ptr, bool alloc);
+
+/**
+ * @brief Times a phase, from construction until it goes out of scope
+ */
+class ProfileScope {
+ public:
+	ProfileScope(enum profile_phase phase) :
+		phase(phase),
+		start(profile_enabled ? profile_now() : 0)
+	{ }
+	~ProfileScope() {
+		if (profile_enabled)
+			profile_add(phase, start);
+	}
+ private:
+	enum profile_phase phase;
+	uint64_t start;
+};
+
+/** @brief Account for a new block on one of the snapshotting heaps */
+static inline void profile_heap_alloc(enum profile_heap heap, void *ptr)
+{
+	if (profile_enabled && ptr)
+		profile_heap_change(heap, ptr, true);
+}
+
+/** @brief Account for a block about to be freed from a snapshotting heap */
+static inline void profile_heap_free(enum profile_heap heap, void *ptr)
+{
+	if (profile_enabled && ptr)
+		profile_heap_change(heap, ptr, false);
+}
+
+/** @brief The time at which the last context switch began */
+extern uint64_t profile_switch_start;
+
+/**
+ * @brief Note the start of a context switch
+ *
+ * The switch ends in a different context, which calls profile_switch_end().
+ */
+static inline void profile_switch_begin()
+{
+	if (profile_enabled)
+		profile_switch_start = profile_now();
+}
+
+/** @brief Note the end of a context switch */
+static inline void profile_switch_end()
+{
+	if (profile_enabled)
+		profile_add(PROFILE_CONTEXT_SWITCH, profile_switch_start);
+}
+
+#endif /* __PROFILE_H__ */
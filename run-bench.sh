@@ -0,0 +1,170 @@
+#!/bin/sh
+#
+# Benchmarks the model checker over the test programs (default: everything in
+# test/, test/litmus and test/nonsc-patterns), and compares the results
+# against a stored baseline
+# Syntax:
+#  ./run-bench.sh [-n RUNS] [-a ARGS] [-T SECONDS] [-b BASELINE] [-t PERCENT]
+#             [-m SECONDS] [-o RESULTS] [-s] [test program...]
+#
+#  -n RUNS      Run each program RUNS times (default: 3); the reported wall
+#               time is the median, and the spread is (max - min) / median
+#  -a ARGS      Model-checker options for every run (default: "-m 2 -y -x 2000")
+#  -T SECONDS   Give up on a run after SECONDS (default: 300)
+#  -b BASELINE  Baseline to compare against (default: bench-baseline.txt)
+#  -t PERCENT   Fail if the total wall time, or the wall time or peak RSS of any
+#               one program, is more than PERCENT worse than the baseline
+#               (default: 10)
+#  -m SECONDS   Only check the wall time of programs which took at least
+#               SECONDS in the baseline; shorter runs are too noisy
+#               (default: 0.5)
+#  -o RESULTS   Write the results to RESULTS (default: bench-results.txt)
+#  -s           Save the results as the new baseline, rather than comparing
+#
+# The numbers are taken from each run's --stats-json output. Wall time only
+# covers the model checker's own run, not the loading of the program.
+#
+
+# Get the directory in which this script and the binaries are located
+BINDIR="${0%/*}"
+
+export LD_LIBRARY_PATH=${BINDIR}
+# For Mac OSX
+export DYLD_LIBRARY_PATH=${BINDIR}
+
+RUNS=3
+ARGS="-m 2 -y -x 2000"
+TIMEOUT=300
+BASELINE=${BINDIR}/bench-baseline.txt
+THRESHOLD=10
+MINTIME=0.5
+RESULTS=${BINDIR}/bench-results.txt
+SAVE=
+
+while getopts "n:a:T:b:t:m:o:s" opt; do
+	case $opt in
+		n) RUNS=$OPTARG ;;
+		a) ARGS=$OPTARG ;;
+		T) TIMEOUT=$OPTARG ;;
+		b) BASELINE=$OPTARG ;;
+		t) THRESHOLD=$OPTARG ;;
+		m) MINTIME=$OPTARG ;;
+		o) RESULTS=$OPTARG ;;
+		s) SAVE=1 ;;
+		*) exit 2 ;;
+	esac
+done
+shift $((OPTIND - 1))
+
+if [ $# -eq 0 ]; then
+	set -- ${BINDIR}/test/*.o ${BINDIR}/test/litmus/*.o ${BINDIR}/test/nonsc-patterns/*.o
+fi
+
+TIMEOUT_CMD=
+command -v timeout > /dev/null && TIMEOUT_CMD="timeout $TIMEOUT"
+
+STATS=$(mktemp) || exit 1
+trap 'rm -f "$STATS"' EXIT
+
+# Print the value of a (top-level, or first nested) numeric field of $STATS
+compute_stats() {
+	sed -n "s/^ *\"$1\": \([0-9.]*\).*/\1/p" "$STATS" | head -n 1
+}
+
+# Print the median of the numbers given as arguments
+median() {
+	printf '%s\n' "$@" | sort -n | awk '{ v[NR] = $1 }
+		END { print (NR % 2) ? v[(NR + 1) / 2] : (v[NR / 2] + v[NR / 2 + 1]) / 2 }'
+}
+
+FAILED=0
+{
+	echo "# Model-checker options: $ARGS"
+	echo "# Runs per program: $RUNS"
+	printf '# %-36s %10s %10s %10s %7s %12s %12s %10s\n' program executions nodes wall_sec spread execs_per_sec nodes_per_sec rss_kb
+} > "$RESULTS"
+
+for prog in "$@"; do
+	[ -x "$prog" ] || continue
+	name=${prog#${BINDIR}/}
+	times=
+	rss=0
+	status=ok
+	i=0
+	while [ $i -lt "$RUNS" ]; do
+		rm -f "$STATS"
+		$TIMEOUT_CMD "$prog" $ARGS --stats-json="$STATS" > /dev/null 2>&1
+		if [ $? -ne 0 ] || [ ! -s "$STATS" ]; then
+			status=failed
+			break
+		fi
+		execs=$(compute_stats total)
+		nodes=$(compute_stats total_nodes)
+		times="$times $(compute_stats wall_time_sec)"
+		r=$(compute_stats peak_rss_kb)
+		[ "$r" -gt "$rss" ] && rss=$r
+		i=$((i + 1))
+	done
+	if [ $status != ok ]; then
+		echo "$name: run failed or timed out" >&2
+		echo "# $name failed" >> "$RESULTS"
+		FAILED=1
+		continue
+	fi
+	wall=$(median $times)
+	printf '%s\n' $times | awk -v name="$name" -v execs="$execs" -v nodes="$nodes" \
+		-v wall="$wall" -v rss="$rss" '
+		NR == 1 || $1 < min { min = $1 }
+		NR == 1 || $1 > max { max = $1 }
+		END {
+			spread = wall > 0 ? 100 * (max - min) / wall : 0
+			printf("  %-36s %10d %10d %10.4f %6.1f%% %12.1f %12.1f %10d\n", name, execs, nodes,
+				wall, spread, wall > 0 ? execs / wall : 0, wall > 0 ? nodes / wall : 0, rss)
+		}' | tee -a "$RESULTS"
+done
+
+if [ -n "$SAVE" ]; then
+	cp "$RESULTS" "$BASELINE" && echo "Saved baseline to $BASELINE"
+	exit $FAILED
+fi
+
+if [ ! -f "$BASELINE" ]; then
+	echo "No baseline at $BASELINE; record one with '$0 -s'"
+	exit $FAILED
+fi
+
+echo
+echo "Comparing against $BASELINE (threshold ${THRESHOLD}%):"
+awk -v threshold="$THRESHOLD" -v mintime="$MINTIME" '
+	/^#/ { next }
+	FNR == NR { execs[$1] = $2; wall[$1] = $4; rss[$1] = $8; next }
+	!($1 in wall) { next }
+	{
+		limit = 1 + threshold / 100
+		if ($2 != execs[$1])
+			printf "  %-36s note: %d executions, was %d\n", $1, $2, execs[$1]
+		if (wall[$1] >= mintime && $4 > wall[$1] * limit) {
+			printf "  %-36s REGRESSION: wall time %.4fs, was %.4fs\n", $1, $4, wall[$1]
+			failed = 1
+		}
+		if ($8 > rss[$1] * limit) {
+			printf "  %-36s REGRESSION: peak RSS %d KB, was %d KB\n", $1, $8, rss[$1]
+			failed = 1
+		}
+		total += $4
+		base_total += wall[$1]
+	}
+	END {
+		printf "  Total wall time: %.4fs, was %.4fs", total, base_total
+		if (base_total > 0)
+			printf " (%+.1f%%)", 100 * (total - base_total) / base_total
+		printf "\n"
+		if (total > base_total * (1 + threshold / 100)) {
+			printf "  REGRESSION: total wall time\n"
+			failed = 1
+		}
+		exit failed
+	}' "$BASELINE" "$RESULTS" || FAILED=1
+
+[ $FAILED -eq 0 ] && echo "OK" || echo "FAILED"
+exit $FAILED
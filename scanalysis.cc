@@ -3,6 +3,7 @@
 #include "threads-model.h"
 #include "clockvector.h"
 #include "execution.h"
+#include "statsjson.h"
 #include <sys/time.h>
 
 
@@ -45,6 +46,9 @@ void SCAnalysis::finish() {
 	model_print("Non-SC count: %u\n", stats->nonsccount);
 	model_print("Total actions: %llu\n", stats->actions);
 	unsigned long long execCount = stats->sccount + stats->nonsccount;
+	/* E.g., a parallel worker which never got any work */
+	if (execCount == 0)
+		return;
 	unsigned long long actionperexec=(stats->actions) / execCount;
 
 	model_print("Elapsed time in buildVector %llu\n", stats->buildVectorTime);
@@ -60,11 +64,38 @@ void SCAnalysis::finish() {
 	model_print("Push per execution: %llu\n", stats->pushCount / execCount);
 	model_print("Merge per execution: %llu\n", stats->mergeCount / execCount);
 	model_print("Processed read actions per execution: %llu\n", stats->processedReads / execCount);
-	model_print("Processed writes calculated per processed read: %llu\n", stats->processedWrites / stats->processedReads);
-	model_print("Length of write lists per processed read: %llu\n", stats->writeListsLength / stats->processedReads);
+	if (stats->processedReads) {
+		model_print("Processed writes calculated per processed read: %llu\n", stats->processedWrites / stats->processedReads);
+		model_print("Length of write lists per processed read: %llu\n", stats->writeListsLength / stats->processedReads);
+	}
 	model_print("Maximum length of write lists: %llu\n", stats->writeListsMaxLength);
 }
 
+/** @brief Write a set of SC statistics as members of a JSON object */
+void sc_statistics_export(struct stats_json *json, const struct sc_statistics *stats) {
+	stats_json_uint(json, "sc_count", stats->sccount);
+	stats_json_uint(json, "nonsc_count", stats->nonsccount);
+	stats_json_uint(json, "actions", stats->actions);
+	stats_json_uint(json, "elapsed_usec", stats->elapsedtime);
+	stats_json_uint(json, "build_vector_time", stats->buildVectorTime);
+	stats_json_uint(json, "compute_cv_time", stats->computeCVTime);
+	stats_json_uint(json, "compute_cv_other_time", stats->computeCVOtherTime);
+	stats_json_uint(json, "process_read_time", stats->processReadTime);
+	stats_json_uint(json, "pass_change_time", stats->passChangeTime);
+	stats_json_uint(json, "reads", stats->reads);
+	stats_json_uint(json, "writes", stats->writes);
+	stats_json_uint(json, "processed_reads", stats->processedReads);
+	stats_json_uint(json, "processed_writes", stats->processedWrites);
+	stats_json_uint(json, "write_lists_length", stats->writeListsLength);
+	stats_json_uint(json, "write_lists_max_length", stats->writeListsMaxLength);
+	stats_json_uint(json, "push_count", stats->pushCount);
+	stats_json_uint(json, "merge_count", stats->mergeCount);
+}
+
+void SCAnalysis::exportStats(struct stats_json *json) {
+	sc_statistics_export(json, stats);
+}
+
 bool SCAnalysis::option(char * opt) {
 	if (strcmp(opt, "verbose")==0) {
 		print_always=true;
@@ -471,7 +502,7 @@ int SCAnalysis::buildVectorsFast(action_list_t *list) {
 			//act->print();
 		}
 
-		ModelAction *lastAct = threadlists[threadid].back();
+		ModelAction *lastAct = threadlists[threadid].empty() ? NULL : threadlists[threadid].back();
 		/* Add the sb edge */
 		if (lastAct != NULL) {
 			action_node *lastNode = nodeMap.get(lastAct);
@@ -35,6 +35,8 @@ struct sc_statistics {
 	unsigned long long mergeCount;
 };
 
+void sc_statistics_export(struct stats_json *json, const struct sc_statistics *stats);
+
 typedef ModelList<const ModelAction*> const_actions_t;
 
 struct action_node;
@@ -78,6 +80,7 @@ class SCAnalysis : public TraceAnalysis {
 	virtual const char * name();
 	virtual bool option(char *);
 	virtual void finish();
+	virtual void exportStats(struct stats_json *json);
 
 
 	SNAPSHOTALLOC
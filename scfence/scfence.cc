@@ -12,6 +12,7 @@
 #include "inferset.h"
 #include "sc_annotation.h"
 #include "errno.h"
+#include "statsjson.h"
 #include <stdio.h>
 #include <algorithm>
 
@@ -43,6 +44,10 @@ void SCFence::finish() {
 	model_print("SCFence finishes!\n");
 }
 
+void SCFence::exportStats(struct stats_json *json) {
+	sc_statistics_export(json, stats);
+}
+
 
 /******************** SCFence-related Functions (Beginning) ********************/
 
@@ -125,6 +125,7 @@ class SCFence : public TraceAnalysis {
 	virtual const char * name();
 	virtual bool option(char *);
 	virtual void finish();
+	virtual void exportStats(struct stats_json *json);
 
 	virtual void inspectModelAction(ModelAction *ac);
 	virtual void actionAtInstallation();
@@ -46,6 +46,7 @@ public:
 	bool is_sleep_set(const Thread *t) const;
 	bool all_threads_sleeping() const;
 	void set_scheduler_thread(thread_id_t tid);
+	thread_id_t get_scheduler_thread() const;
 
 	SNAPSHOTALLOC
 private:
@@ -141,7 +141,7 @@ static void SnapshotGlobalSegments()
 int SnapshotStack::backTrackBeforeStep(int seqindex)
 {
 	int i;
-	for (i = (int)stack.size() - 1; i >= 0; i++)
+	for (i = (int)stack.size() - 1; i >= 0; i--)
 		if (stack[i].index <= seqindex)
 			break;
 		else
@@ -12,6 +12,15 @@
 #include "mymemory.h"
 #include "common.h"
 #include "context.h"
+#include "stackpool.h"
+
+#if USE_MPROTECT_SNAPSHOT == 3
+#include <fcntl.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/fs.h>
+#include <linux/userfaultfd.h>
+#endif
 
 /** PageAlignedAdressUpdate return a page aligned address for the
  * address being added as a side effect the numBytes are also changed.
@@ -32,6 +41,352 @@ struct SnapShotRecord {
 /** @brief Backing store page */
 typedef unsigned char snapshot_page_t[PAGESIZE];
 
+#endif /* USE_MPROTECT_SNAPSHOT */
+
+#if USE_MPROTECT_SNAPSHOT == 3
+
+/*
+ * Snapshotting by userfaultfd write-protection: the snapshotted regions are
+ * registered for asynchronous write-protect tracking, so the kernel resolves
+ * the first write to each protected page by itself (no signal, no mprotect),
+ * and we find all of the written pages in bulk with the PAGEMAP_SCAN ioctl,
+ * which can write-protect them again at the same time.
+ *
+ * Since the pages are found only after they have been written, we keep a
+ * mirror of each region holding its contents as of the last snapshot. Taking
+ * a snapshot logs the mirror copies of the pages written since the previous
+ * one to the backing store (as the pre-images which revert to it), then
+ * brings the mirror up to date.
+ */
+
+/* Older kernel headers lack the async write-protect and PAGEMAP_SCAN API */
+#ifndef UFFD_USER_MODE_ONLY
+#define UFFD_USER_MODE_ONLY 1
+#endif
+#ifndef UFFD_FEATURE_WP_ASYNC
+#define UFFD_FEATURE_WP_ASYNC (1 << 15)
+#endif
+#ifndef PAGEMAP_SCAN
+#define PAGE_IS_WRITTEN (1 << 1)
+#define PAGE_IS_PRESENT (1 << 3)
+#define PAGE_IS_SWAPPED (1 << 4)
+#define PM_SCAN_WP_MATCHING (1 << 0)
+#define PM_SCAN_CHECK_WPASYNC (1 << 1)
+
+struct page_region {
+	uint64_t start;
+	uint64_t end;
+	uint64_t categories;
+};
+
+struct pm_scan_arg {
+	uint64_t size;
+	uint64_t flags;
+	uint64_t start;
+	uint64_t end;
+	uint64_t walk_end;
+	uint64_t vec;
+	uint64_t vec_len;
+	uint64_t max_pages;
+	uint64_t category_inverted;
+	uint64_t category_mask;
+	uint64_t category_anyof_mask;
+	uint64_t return_mask;
+};
+
+#define PAGEMAP_SCAN _IOWR('f', 16, struct pm_scan_arg)
+#endif
+
+/** @brief Number of written ranges to fetch with each PAGEMAP_SCAN */
+#define UFFD_SCAN_RANGES 64
+
+/** @brief A snapshotted memory region, and its mirror */
+struct TrackedRegion {
+	void *basePtr; // base of memory region
+	void *mirrorPtr; // contents of the memory region as of the last snapshot
+	int sizeInPages; // size of memory region in pages
+};
+
+/** @brief The pre-image of a page, logged to the backing store */
+struct LoggedPageRecord {
+	void *basePtrOfPage;
+	void *mirrorOfPage;
+};
+
+/* Primary struct for snapshotting system */
+struct uffd_snapshotter {
+	uffd_snapshotter(unsigned int numbackingpages, unsigned int numsnapshots, unsigned int nummemoryregions);
+	~uffd_snapshotter();
+
+	struct TrackedRegion *regionsToSnapShot; //This pointer references an array of memory regions to snapshot
+	snapshot_page_t *backingStore; //This pointer references an array of snapshotpage's that form the backing store
+	void *backingStoreBasePtr; //This pointer references an array of snapshotpage's that form the backing store
+	struct LoggedPageRecord *backingRecords; //This pointer references an array of loggedpagerecord's (same number of elements as backingstore
+	struct SnapShotRecord *snapShots; //This pointer references the snapshot array
+	struct page_region scanRanges[UFFD_SCAN_RANGES]; //Results of the last PAGEMAP_SCAN
+
+	unsigned int lastSnapShot; //Stores the next snapshot record we should use
+	unsigned int lastBackingPage; //Stores the next backingpage we should use
+	unsigned int lastRegion; //Stores the next memory region to be used
+
+	unsigned int maxRegions; //Stores the max number of memory regions we support
+	unsigned int maxBackingPages; //Stores the total number of backing pages
+	unsigned int maxSnapShots; //Stores the total number of snapshots we allow
+
+	int uffd; //The userfaultfd with which our regions are registered
+	int pagemap; //The pagemap of our process, for PAGEMAP_SCAN
+	pid_t owner; //The process which opened uffd and pagemap
+
+	MEMALLOC
+};
+
+static struct uffd_snapshotter *uffd_snap = NULL;
+
+uffd_snapshotter::uffd_snapshotter(unsigned int backing_pages, unsigned int snapshots, unsigned int regions) :
+	lastSnapShot(0),
+	lastBackingPage(0),
+	lastRegion(0),
+	maxRegions(regions),
+	maxBackingPages(backing_pages),
+	maxSnapShots(snapshots),
+	uffd(-1),
+	pagemap(-1),
+	owner(0)
+{
+	regionsToSnapShot = (struct TrackedRegion *)model_malloc(sizeof(struct TrackedRegion) * regions);
+	backingStoreBasePtr = (void *)model_malloc(sizeof(snapshot_page_t) * (backing_pages + 1));
+	//Page align the backingstorepages
+	backingStore = (snapshot_page_t *)PageAlignAddressUpward(backingStoreBasePtr);
+	backingRecords = (struct LoggedPageRecord *)model_malloc(sizeof(struct LoggedPageRecord) * backing_pages);
+	snapShots = (struct SnapShotRecord *)model_malloc(sizeof(struct SnapShotRecord) * snapshots);
+}
+
+uffd_snapshotter::~uffd_snapshotter()
+{
+	model_free(regionsToSnapShot);
+	model_free(backingStoreBasePtr);
+	model_free(backingRecords);
+	model_free(snapShots);
+}
+
+/** @brief Register a memory region for write-protect tracking */
+static void uffd_register_region(struct TrackedRegion *region)
+{
+	struct uffdio_register reg;
+	memset(&reg, 0, sizeof(reg));
+	reg.range.start = (uintptr_t)region->basePtr;
+	reg.range.len = region->sizeInPages * sizeof(snapshot_page_t);
+	reg.mode = UFFDIO_REGISTER_MODE_WP;
+	if (ioctl(uffd_snap->uffd, UFFDIO_REGISTER, &reg) == -1) {
+		perror("ioctl(UFFDIO_REGISTER)");
+		model_print("Failed to register snapshot region %p for write-protection\n", region->basePtr);
+		exit(EXIT_FAILURE);
+	}
+}
+
+/**
+ * @brief Set up write-protect tracking for this process
+ *
+ * Neither the userfaultfd registration nor the pagemap file carry over into a
+ * child process (as in parallel exploration), so a child must set up its own.
+ * The child starts out with every page unprotected, and hence written, which
+ * is conservative: written pages which match the mirror are simply copied
+ * back and forth.
+ */
+static void uffd_open()
+{
+	if (uffd_snap->uffd >= 0) {
+		close(uffd_snap->uffd);
+		close(uffd_snap->pagemap);
+	}
+	uffd_snap->owner = getpid();
+
+	uffd_snap->uffd = syscall(SYS_userfaultfd, O_CLOEXEC | O_NONBLOCK | UFFD_USER_MODE_ONLY);
+	if (uffd_snap->uffd < 0) {
+		perror("userfaultfd");
+		exit(EXIT_FAILURE);
+	}
+	struct uffdio_api api;
+	memset(&api, 0, sizeof(api));
+	api.api = UFFD_API;
+	api.features = UFFD_FEATURE_WP_ASYNC;
+	if (ioctl(uffd_snap->uffd, UFFDIO_API, &api) == -1) {
+		perror("ioctl(UFFDIO_API)");
+		model_print("Asynchronous write-protection requires Linux 6.7 or newer\n");
+		exit(EXIT_FAILURE);
+	}
+
+	uffd_snap->pagemap = open("/proc/self/pagemap", O_RDONLY | O_CLOEXEC);
+	if (uffd_snap->pagemap < 0) {
+		perror("open(/proc/self/pagemap)");
+		exit(EXIT_FAILURE);
+	}
+
+	for (unsigned int region = 0; region < uffd_snap->lastRegion; region++)
+		uffd_register_region(&uffd_snap->regionsToSnapShot[region]);
+}
+
+/** @brief Make sure that write-protect tracking belongs to this process */
+static void uffd_check_owner()
+{
+	if (uffd_snap->owner != getpid())
+		uffd_open();
+}
+
+/**
+ * @brief Find the pages of a region which have been written since they were
+ * last write-protected
+ *
+ * Pages which have never been touched are neither reported nor protected:
+ * they read as zero, just like their (untouched) mirror, and the first write
+ * to one maps in a page which is not protected, so it shows up as written.
+ * This keeps the page tables of the (mostly unused) heaps sparse, which the
+ * scan relies on to be fast.
+ *
+ * @param region The region to scan
+ * @param protect Also write-protect the written pages
+ * @param func Called with the base address of each written page
+ */
+static void uffd_scan_region(struct TrackedRegion *region, bool protect, void (*func)(struct TrackedRegion *, void *))
+{
+	struct pm_scan_arg arg;
+	memset(&arg, 0, sizeof(arg));
+	arg.size = sizeof(arg);
+	arg.flags = PM_SCAN_CHECK_WPASYNC | (protect ? PM_SCAN_WP_MATCHING : 0);
+	arg.start = (uintptr_t)region->basePtr;
+	arg.end = arg.start + region->sizeInPages * sizeof(snapshot_page_t);
+	arg.vec = (uintptr_t)uffd_snap->scanRanges;
+	arg.vec_len = UFFD_SCAN_RANGES;
+	arg.category_mask = PAGE_IS_WRITTEN;
+	arg.category_anyof_mask = PAGE_IS_PRESENT | PAGE_IS_SWAPPED;
+	arg.return_mask = PAGE_IS_WRITTEN;
+
+	do {
+		int ranges = ioctl(uffd_snap->pagemap, PAGEMAP_SCAN, &arg);
+		if (ranges < 0) {
+			perror("ioctl(PAGEMAP_SCAN)");
+			model_print("Failed to scan snapshot region %p\n", region->basePtr);
+			exit(EXIT_FAILURE);
+		}
+		for (int i = 0; i < ranges; i++) {
+			struct page_region *range = &uffd_snap->scanRanges[i];
+			for (uintptr_t page = range->start; page < range->end; page += PAGESIZE)
+				func(region, (void *)page);
+		}
+		arg.start = arg.walk_end;
+	} while (arg.start < arg.end);
+}
+
+/** @return The mirror of a page from a region */
+static void * uffd_mirror_of(struct TrackedRegion *region, void *addr)
+{
+	return (char *)region->mirrorPtr + ((uintptr_t)addr - (uintptr_t)region->basePtr);
+}
+
+/** @brief Log the pre-image of a page written since the last snapshot, and
+ *  bring its mirror up to date */
+static void uffd_log_page(struct TrackedRegion *region, void *addr)
+{
+	void *mirror = uffd_mirror_of(region, addr);
+	if (uffd_snap->lastSnapShot > 0) {
+		unsigned int backingpage = uffd_snap->lastBackingPage++;
+		if (backingpage == uffd_snap->maxBackingPages) {
+			model_print("Out of backing pages at %p\n", addr);
+			exit(EXIT_FAILURE);
+		}
+		memcpy(&uffd_snap->backingStore[backingpage], mirror, sizeof(snapshot_page_t));
+		uffd_snap->backingRecords[backingpage].basePtrOfPage = addr;
+		uffd_snap->backingRecords[backingpage].mirrorOfPage = mirror;
+	}
+	memcpy(mirror, addr, sizeof(snapshot_page_t));
+}
+
+/** @brief Revert a page written since the last snapshot */
+static void uffd_revert_page(struct TrackedRegion *region, void *addr)
+{
+	memcpy(addr, uffd_mirror_of(region, addr), sizeof(snapshot_page_t));
+}
+
+static void uffd_snapshot_init(unsigned int numbackingpages,
+		unsigned int numsnapshots, unsigned int nummemoryregions,
+		unsigned int numheappages, VoidFuncPtr entryPoint)
+{
+	uffd_snap = new uffd_snapshotter(numbackingpages, numsnapshots, nummemoryregions);
+	uffd_open();
+
+	void *basemySpace = model_malloc((numheappages + 1) * PAGESIZE);
+	void *pagealignedbase = PageAlignAddressUpward(basemySpace);
+	user_snapshot_space = create_mspace_with_base(pagealignedbase, numheappages * PAGESIZE, 1);
+	snapshot_add_memory_region(pagealignedbase, numheappages);
+
+	void *base_model_snapshot_space = model_malloc((numheappages + 1) * PAGESIZE);
+	pagealignedbase = PageAlignAddressUpward(base_model_snapshot_space);
+	model_snapshot_space = create_mspace_with_base(pagealignedbase, numheappages * PAGESIZE, 1);
+	snapshot_add_memory_region(pagealignedbase, numheappages);
+
+	entryPoint();
+}
+
+static void uffd_add_to_snapshot(void *addr, unsigned int numPages)
+{
+	unsigned int memoryregion = uffd_snap->lastRegion++;
+	if (memoryregion == uffd_snap->maxRegions) {
+		model_print("Exceeded supported number of memory regions!\n");
+		exit(EXIT_FAILURE);
+	}
+
+	DEBUG("snapshot region %p-%p (%u page%s)\n",
+			addr, (char *)addr + numPages * PAGESIZE, numPages,
+			numPages > 1 ? "s" : "");
+	struct TrackedRegion *region = &uffd_snap->regionsToSnapShot[memoryregion];
+	region->basePtr = addr;
+	region->sizeInPages = numPages;
+	region->mirrorPtr = mmap(NULL, numPages * sizeof(snapshot_page_t), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANON | MAP_NORESERVE, -1, 0);
+	if (region->mirrorPtr == MAP_FAILED) {
+		perror("mmap");
+		exit(EXIT_FAILURE);
+	}
+	uffd_register_region(region);
+}
+
+static snapshot_id uffd_take_snapshot()
+{
+	uffd_check_owner();
+	for (unsigned int region = 0; region < uffd_snap->lastRegion; region++)
+		uffd_scan_region(&uffd_snap->regionsToSnapShot[region], true, uffd_log_page);
+
+	unsigned int snapshot = uffd_snap->lastSnapShot++;
+	if (snapshot == uffd_snap->maxSnapShots) {
+		model_print("Out of snapshots\n");
+		exit(EXIT_FAILURE);
+	}
+	uffd_snap->snapShots[snapshot].firstBackingPage = uffd_snap->lastBackingPage;
+
+	return snapshot;
+}
+
+static void uffd_roll_back(snapshot_id theID)
+{
+	uffd_check_owner();
+	/* Revert to the last snapshot. As with the tuned mprotect algorithm,
+	 * the reverted pages are left writable (and so still count as written)
+	 * rather than protected again: the next execution will most likely
+	 * write to them again, and reverting them costs no more than a fault. */
+	for (unsigned int region = 0; region < uffd_snap->lastRegion; region++)
+		uffd_scan_region(&uffd_snap->regionsToSnapShot[region], false, uffd_revert_page);
+	/* Then undo back to the requested one, newest pre-image first */
+	for (unsigned int page = uffd_snap->lastBackingPage; page > uffd_snap->snapShots[theID].firstBackingPage; page--) {
+		struct LoggedPageRecord *record = &uffd_snap->backingRecords[page - 1];
+		memcpy(record->basePtrOfPage, &uffd_snap->backingStore[page - 1], sizeof(snapshot_page_t));
+		memcpy(record->mirrorOfPage, &uffd_snap->backingStore[page - 1], sizeof(snapshot_page_t));
+	}
+	/* All later snapshots are cleared */
+	uffd_snap->lastSnapShot = theID + 1;
+	uffd_snap->lastBackingPage = uffd_snap->snapShots[theID].firstBackingPage;
+}
+
+#elif USE_MPROTECT_SNAPSHOT
+
 /* List the base address of the corresponding page in the backing store so we
  * know where to copy it to */
 struct BackingPageRecord {
@@ -105,6 +460,10 @@ mprot_snapshotter::~mprot_snapshotter()
  */
 static void mprot_handle_pf(int sig, siginfo_t *si, void *unused)
 {
+	if (stack_pool_is_guard(si->si_addr)) {
+		model_print("Stack overflow in a user thread at %p (see --stack-size)\n", si->si_addr);
+		exit(EXIT_FAILURE);
+	}
 	if (si->si_code == SEGV_MAPERR) {
 		model_print("Segmentation fault at %p\n", si->si_addr);
 		model_print("For debugging, place breakpoint at: %s:%d\n",
@@ -197,15 +556,38 @@ static void mprot_add_to_snapshot(void *addr, unsigned int numPages)
 	mprot_snap->regionsToSnapShot[memoryregion].sizeInPages = numPages;
 }
 
-static snapshot_id mprot_take_snapshot()
+/**
+ * @brief Write-protect the pages which have been written since the last
+ * snapshot, or all of the snapshotted memory when taking the first snapshot
+ *
+ * Pages become writable when they are first copied to the backing store after
+ * a snapshot (see mprot_handle_pf), so the pages recorded since the last
+ * snapshot are exactly the writable ones.
+ */
+static void mprot_protect_dirty_pages()
 {
-	for (unsigned int region = 0; region < mprot_snap->lastRegion; region++) {
-		if (mprotect(mprot_snap->regionsToSnapShot[region].basePtr, mprot_snap->regionsToSnapShot[region].sizeInPages * sizeof(snapshot_page_t), PROT_READ) == -1) {
+	if (mprot_snap->lastSnapShot == 0) {
+		for (unsigned int region = 0; region < mprot_snap->lastRegion; region++) {
+			if (mprotect(mprot_snap->regionsToSnapShot[region].basePtr, mprot_snap->regionsToSnapShot[region].sizeInPages * sizeof(snapshot_page_t), PROT_READ) == -1) {
+				perror("mprotect");
+				model_print("Failed to mprotect inside of takeSnapShot\n");
+				exit(EXIT_FAILURE);
+			}
+		}
+		return;
+	}
+	for (unsigned int page = mprot_snap->snapShots[mprot_snap->lastSnapShot - 1].firstBackingPage; page < mprot_snap->lastBackingPage; page++) {
+		if (mprotect(mprot_snap->backingRecords[page].basePtrOfPage, sizeof(snapshot_page_t), PROT_READ) == -1) {
 			perror("mprotect");
 			model_print("Failed to mprotect inside of takeSnapShot\n");
 			exit(EXIT_FAILURE);
 		}
 	}
+}
+
+static snapshot_id mprot_take_snapshot()
+{
+	mprot_protect_dirty_pages();
 	unsigned int snapshot = mprot_snap->lastSnapShot++;
 	if (snapshot == mprot_snap->maxSnapShots) {
 		model_print("Out of snapshots\n");
@@ -227,23 +609,30 @@ static void mprot_roll_back(snapshot_id theID)
 	}
 #endif
 
+	/* Restore the oldest copy of each page written since the snapshot, and
+	 * leave it write-protected, as it was right after the snapshot. Only
+	 * the pages written since the last snapshot are writable. */
 	HashTable< void *, bool, uintptr_t, 4, model_malloc, model_calloc, model_free> duplicateMap;
-	for (unsigned int region = 0; region < mprot_snap->lastRegion; region++) {
-		if (mprotect(mprot_snap->regionsToSnapShot[region].basePtr, mprot_snap->regionsToSnapShot[region].sizeInPages * sizeof(snapshot_page_t), PROT_READ | PROT_WRITE) == -1) {
+	for (unsigned int page = mprot_snap->snapShots[theID].firstBackingPage; page < mprot_snap->lastBackingPage; page++) {
+		void *addr = mprot_snap->backingRecords[page].basePtrOfPage;
+		if (duplicateMap.contains(addr))
+			continue;
+		duplicateMap.put(addr, true);
+		if (mprotect(addr, sizeof(snapshot_page_t), PROT_READ | PROT_WRITE) == -1) {
 			perror("mprotect");
-			model_print("Failed to mprotect inside of takeSnapShot\n");
+			model_print("Failed to mprotect inside of rollBack\n");
 			exit(EXIT_FAILURE);
 		}
-	}
-	for (unsigned int page = mprot_snap->snapShots[theID].firstBackingPage; page < mprot_snap->lastBackingPage; page++) {
-		if (!duplicateMap.contains(mprot_snap->backingRecords[page].basePtrOfPage)) {
-			duplicateMap.put(mprot_snap->backingRecords[page].basePtrOfPage, true);
-			memcpy(mprot_snap->backingRecords[page].basePtrOfPage, &mprot_snap->backingStore[page], sizeof(snapshot_page_t));
+		memcpy(addr, &mprot_snap->backingStore[page], sizeof(snapshot_page_t));
+		if (mprotect(addr, sizeof(snapshot_page_t), PROT_READ) == -1) {
+			perror("mprotect");
+			model_print("Failed to mprotect inside of rollBack\n");
+			exit(EXIT_FAILURE);
 		}
 	}
-	mprot_snap->lastSnapShot = theID;
+	/* All later snapshots are cleared */
+	mprot_snap->lastSnapShot = theID + 1;
 	mprot_snap->lastBackingPage = mprot_snap->snapShots[theID].firstBackingPage;
-	mprot_take_snapshot(); //Make sure current snapshot is still good...All later ones are cleared
 }
 
 #else /* !USE_MPROTECT_SNAPSHOT */
@@ -360,6 +749,72 @@ mspace create_shared_mspace()
 	return create_mspace_with_base((void *)(fork_snap->mSharedMemoryBase), SHARED_MEMORY_DEFAULT - sizeof(*fork_snap), 1);
 }
 
+/** @brief Wait for a child process to exit */
+static void fork_wait(pid_t pid)
+{
+	while (waitpid(pid, NULL, 0) < 0) {
+		/* waitpid() may be interrupted */
+		if (errno != EINTR) {
+			perror("waitpid");
+			exit(EXIT_FAILURE);
+		}
+	}
+}
+
+/**
+ * @brief Fork a spare process, parked at the current snapshot point
+ *
+ * A snapshot process which has been rolled back to keeps a spare child on
+ * hand, so that rolling back to it again is a handoff to the spare rather
+ * than a fork on the critical path. The next spare is then forked while the
+ * new child runs.
+ *
+ * @param handoff Returns the pipe on which the spare waits; writing to it
+ * wakes the spare up, and closing it discards the spare
+ * @return The PID of the spare
+ */
+static pid_t fork_spare(int *handoff)
+{
+	int fds[2];
+	if (pipe(fds) < 0) {
+		perror("pipe");
+		exit(EXIT_FAILURE);
+	}
+	pid_t forkedID = fork();
+	if (forkedID < 0) {
+		perror("fork");
+		exit(EXIT_FAILURE);
+	}
+	if (0 == forkedID) {
+		char c;
+		ssize_t ret;
+		close(fds[1]);
+		while ((ret = read(fds[0], &c, 1)) < 0 && errno == EINTR)
+			;
+		/* Discarded (don't flush our copy of the parent's stdio) */
+		if (ret != 1)
+			_exit(EXIT_SUCCESS);
+		close(fds[0]);
+		setcontext(&fork_snap->shared_ctxt);
+	}
+	close(fds[0]);
+	*handoff = fds[1];
+	return forkedID;
+}
+
+/** @brief Hand the execution over to a spare process */
+static void fork_wake_spare(int handoff)
+{
+	char c = 0;
+	while (write(handoff, &c, 1) < 0) {
+		if (errno != EINTR) {
+			perror("write");
+			exit(EXIT_FAILURE);
+		}
+	}
+	close(handoff);
+}
+
 static void fork_snapshot_init(unsigned int numbackingpages,
 		unsigned int numsnapshots, unsigned int nummemoryregions,
 		unsigned int numheappages, VoidFuncPtr entryPoint)
@@ -384,28 +839,33 @@ static void fork_snapshot_init(unsigned int numbackingpages,
 	/* switch back here when takesnapshot is called */
 	snapshotid = fork_snap->currSnapShotID;
 
+	int handoff;
+	pid_t spareID = fork_spare(&handoff);
+	bool rolledback = false;
 	while (true) {
-		pid_t forkedID;
+		pid_t forkedID = spareID;
 		fork_snap->currSnapShotID = snapshotid + 1;
-		forkedID = fork();
-
-		if (0 == forkedID) {
-			setcontext(&fork_snap->shared_ctxt);
-		} else {
-			DEBUG("parent PID: %d, child PID: %d, snapshot ID: %d\n",
-			        getpid(), forkedID, snapshotid);
-
-			while (waitpid(forkedID, NULL, 0) < 0) {
-				/* waitpid() may be interrupted */
-				if (errno != EINTR) {
-					perror("waitpid");
-					exit(EXIT_FAILURE);
-				}
-			}
+		fork_wake_spare(handoff);
+		/* Once we have been rolled back to, we are likely to be again:
+		 * park the next spare while the child runs */
+		spareID = rolledback ? fork_spare(&handoff) : -1;
 
-			if (fork_snap->mIDToRollback != snapshotid)
-				exit(EXIT_SUCCESS);
+		DEBUG("parent PID: %d, child PID: %d, snapshot ID: %d\n",
+		        getpid(), forkedID, snapshotid);
+
+		fork_wait(forkedID);
+
+		if (fork_snap->mIDToRollback != snapshotid) {
+			if (spareID >= 0) {
+				/* Discard the spare */
+				close(handoff);
+				fork_wait(spareID);
+			}
+			exit(EXIT_SUCCESS);
 		}
+		if (spareID < 0)
+			spareID = fork_spare(&handoff);
+		rolledback = true;
 	}
 }
 
@@ -434,7 +894,9 @@ void snapshot_system_init(unsigned int numbackingpages,
 		unsigned int numsnapshots, unsigned int nummemoryregions,
 		unsigned int numheappages, VoidFuncPtr entryPoint)
 {
-#if USE_MPROTECT_SNAPSHOT
+#if USE_MPROTECT_SNAPSHOT == 3
+	uffd_snapshot_init(numbackingpages, numsnapshots, nummemoryregions, numheappages, entryPoint);
+#elif USE_MPROTECT_SNAPSHOT
 	mprot_snapshot_init(numbackingpages, numsnapshots, nummemoryregions, numheappages, entryPoint);
 #else
 	fork_snapshot_init(numbackingpages, numsnapshots, nummemoryregions, numheappages, entryPoint);
@@ -444,7 +906,9 @@ void snapshot_system_init(unsigned int numbackingpages,
 /** Assumes that addr is page aligned. */
 void snapshot_add_memory_region(void *addr, unsigned int numPages)
 {
-#if USE_MPROTECT_SNAPSHOT
+#if USE_MPROTECT_SNAPSHOT == 3
+	uffd_add_to_snapshot(addr, numPages);
+#elif USE_MPROTECT_SNAPSHOT
 	mprot_add_to_snapshot(addr, numPages);
 #else
 	/* not needed for fork-based snapshotting */
@@ -456,19 +920,45 @@ void snapshot_add_memory_region(void *addr, unsigned int numPages)
  */
 snapshot_id take_snapshot()
 {
-#if USE_MPROTECT_SNAPSHOT
+#if USE_MPROTECT_SNAPSHOT == 3
+	return uffd_take_snapshot();
+#elif USE_MPROTECT_SNAPSHOT
 	return mprot_take_snapshot();
 #else
 	return fork_take_snapshot();
 #endif
 }
 
+/**
+ * @brief Check whether another snapshot can be taken safely
+ *
+ * Every snapshot holds on to the backing pages dirtied after it was taken, so
+ * we stop taking (optional) snapshots well before the backing store fills up,
+ * leaving most of it to the rest of the execution.
+ *
+ * @return True if there is room for another snapshot
+ */
+bool snapshot_has_room()
+{
+#if USE_MPROTECT_SNAPSHOT == 3
+	return uffd_snap->lastSnapShot + 1 < uffd_snap->maxSnapShots &&
+		uffd_snap->lastBackingPage < uffd_snap->maxBackingPages / 4;
+#elif USE_MPROTECT_SNAPSHOT
+	return mprot_snap->lastSnapShot + 1 < mprot_snap->maxSnapShots &&
+		mprot_snap->lastBackingPage < mprot_snap->maxBackingPages / 4;
+#else
+	return true;
+#endif
+}
+
 /** Rolls the memory state back to the given snapshot identifier.
  *  @param theID is the snapshot identifier to rollback to.
  */
 void snapshot_roll_back(snapshot_id theID)
 {
-#if USE_MPROTECT_SNAPSHOT
+#if USE_MPROTECT_SNAPSHOT == 3
+	uffd_roll_back(theID);
+#elif USE_MPROTECT_SNAPSHOT
 	mprot_roll_back(theID);
 #else
 	fork_roll_back(theID);
@@ -2,6 +2,7 @@
 #define _METHODCALL_H
 
 #include "stl-model.h"
+#include "chunklist.h"
 #include "action.h"
 #include "spec_common.h"
 
@@ -9,7 +10,7 @@ class MethodCall;
 
 typedef MethodCall *Method;
 typedef SnapSet<Method> *MethodSet;
-typedef SnapList<ModelAction *> action_list_t;
+typedef ChunkList<ModelAction *> action_list_t;
 
 typedef SnapList<Method> MethodList;
 typedef SnapVector<Method> MethodVector;
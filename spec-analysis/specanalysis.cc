@@ -8,6 +8,7 @@
 #include <assert.h>
 #include "modeltypes.h"
 #include "executiongraph.h"
+#include "statsjson.h"
 
 
 SPECAnalysis::SPECAnalysis()
@@ -34,6 +35,18 @@ const char * SPECAnalysis::name() {
 	return name;
 }
 
+void SPECAnalysis::exportStats(struct stats_json *json) {
+	stats_json_uint(json, "traces", stats->traceCnt);
+	stats_json_uint(json, "passed", stats->passCnt);
+	stats_json_uint(json, "buggy", stats->buggyCnt);
+	stats_json_uint(json, "bug_free", stats->bugfreeCnt);
+	stats_json_uint(json, "broken_graph", stats->brokenCnt);
+	stats_json_uint(json, "cyclic_graph", stats->cyclicCnt);
+	stats_json_uint(json, "no_ordering_point", stats->noOrderingPointCnt);
+	stats_json_uint(json, "inadmissible", stats->inadmissibilityCnt);
+	stats_json_uint(json, "failed", stats->failedCnt);
+}
+
 void SPECAnalysis::finish() {
 	model_print("\n");
 	model_print(">>>>>>>> SPECAnalysis finished <<<<<<<<\n");
@@ -45,6 +45,7 @@ class SPECAnalysis : public TraceAnalysis {
 	virtual const char * name();
 	virtual bool option(char *);
 	virtual void finish();
+	virtual void exportStats(struct stats_json *json);
 
 	/** Some stats */
 	spec_stats *stats;
@@ -0,0 +1,93 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include "stackpool.h"
+#include "common.h"
+#include "config.h"
+
+#ifndef MAP_NORESERVE
+#define MAP_NORESERVE 0
+#endif
+
+/*
+ * The pool's bookkeeping is mapped directly, rather than allocated from the
+ * model checker's heap: with fork-based snapshotting, that heap is shared
+ * between the processes, while the stacks are private to each one.
+ */
+
+/** @brief The (usable) base of each stack, indexed by thread ID; NULL if not
+ *  yet reserved */
+static void **stacks = NULL;
+static unsigned int capacity = 0;
+static unsigned int num_stacks = 0;
+static size_t stack_size = 0;
+
+/** @brief Map fresh, private, anonymous memory; exits on failure */
+static void * map_anonymous(size_t size, int flags)
+{
+	void *mem = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANON | flags, -1, 0);
+	if (mem == MAP_FAILED) {
+		perror("mmap");
+		exit(EXIT_FAILURE);
+	}
+	return mem;
+}
+
+/**
+ * @brief Get the stack for a user thread
+ * @param index The thread's ID
+ * @param size The size of the stack, in bytes; a multiple of the page size,
+ * and the same for every call
+ * @return The lowest usable address of the stack
+ */
+void * stack_pool_get(unsigned int index, size_t size)
+{
+	if (!stack_size)
+		stack_size = size;
+	ASSERT(size == stack_size && size % PAGESIZE == 0);
+
+	if (index >= capacity) {
+		unsigned int newcapacity = capacity ? capacity * 2 : 16;
+		if (newcapacity <= index)
+			newcapacity = index + 1;
+		void **newstacks = (void **)map_anonymous(newcapacity * sizeof(*stacks), 0);
+		if (stacks) {
+			memcpy(newstacks, stacks, capacity * sizeof(*stacks));
+			munmap(stacks, capacity * sizeof(*stacks));
+		}
+		stacks = newstacks;
+		capacity = newcapacity;
+	}
+
+	if (!stacks[index]) {
+		char *mem = (char *)map_anonymous(PAGESIZE + stack_size, MAP_NORESERVE);
+		if (mprotect(mem, PAGESIZE, PROT_NONE)) {
+			perror("mprotect");
+			exit(EXIT_FAILURE);
+		}
+		stacks[index] = mem + PAGESIZE;
+		if (index >= num_stacks)
+			num_stacks = index + 1;
+	}
+	return stacks[index];
+}
+
+/**
+ * @brief Check whether an address is in the guard page of one of the stacks
+ *
+ * Safe to call from a signal handler.
+ *
+ * @param addr The address
+ * @return True if an access to addr is a stack overflow
+ */
+bool stack_pool_is_guard(const void *addr)
+{
+	for (unsigned int i = 0; i < num_stacks; i++) {
+		const char *base = (const char *)stacks[i];
+		if (base && (const char *)addr >= base - PAGESIZE && (const char *)addr < base)
+			return true;
+	}
+	return false;
+}
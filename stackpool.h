@@ -0,0 +1,22 @@
+/** @file stackpool.h
+ *  @brief Pool of stacks for the user threads.
+ *
+ * The stacks live outside of the snapshotting heap, and are reused from one
+ * execution to the next. Each thread runs on the stack belonging to its
+ * thread ID, so a stack is never handed to two threads which both exist in
+ * some snapshot, and the pool itself never needs to be rolled back; only the
+ * live part of each stack is saved along with a mid-execution snapshot.
+ *
+ * Each stack is reserved with an inaccessible guard page below it, and its
+ * pages are only committed as they are first touched.
+ */
+
+#ifndef __STACKPOOL_H__
+#define __STACKPOOL_H__
+
+#include <stddef.h>
+
+void * stack_pool_get(unsigned int index, size_t size);
+bool stack_pool_is_guard(const void *addr);
+
+#endif /* __STACKPOOL_H__ */
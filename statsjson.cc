@@ -0,0 +1,112 @@
+#include <stdio.h>
+#include <stdarg.h>
+
+#include "statsjson.h"
+#include "common.h"
+
+/** @brief Formatted output to the JSON document (like model_print) */
+static void json_printf(struct stats_json *json, const char *fmt, ...)
+{
+	va_list ap;
+	va_start(ap, fmt);
+	switch_alloc = 1;
+	vdprintf(json->fd, fmt, ap);
+	switch_alloc = 0;
+	va_end(ap);
+}
+
+/** @brief Start a new member of the current object, up to its value */
+static void write_key(struct stats_json *json, const char *key)
+{
+	json_printf(json, "%s\n%*s\"%s\": ", json->empty ? "" : ",", 2 * json->depth, "", key);
+	json->empty = false;
+}
+
+/**
+ * @brief Start writing a JSON document (a single, top-level object)
+ * @param json The writer state to initialize
+ * @param fd The file descriptor to write to
+ */
+void stats_json_begin(struct stats_json *json, int fd)
+{
+	json->fd = fd;
+	json->depth = 1;
+	json->empty = true;
+	json_printf(json, "{");
+}
+
+/** @brief Finish the JSON document */
+void stats_json_end(struct stats_json *json)
+{
+	stats_json_end_object(json);
+	json_printf(json, "\n");
+}
+
+/**
+ * @brief Start a nested object; its members follow, up to the matching
+ * stats_json_end_object()
+ * @param json The writer
+ * @param key The name of the object
+ */
+void stats_json_begin_object(struct stats_json *json, const char *key)
+{
+	write_key(json, key);
+	json_printf(json, "{");
+	json->depth++;
+	json->empty = true;
+}
+
+/** @brief Finish the object being written */
+void stats_json_end_object(struct stats_json *json)
+{
+	json->depth--;
+	if (json->empty)
+		json_printf(json, "}");
+	else
+		json_printf(json, "\n%*s}", 2 * json->depth, "");
+	json->empty = false;
+}
+
+/** @brief Write an unsigned integer member */
+void stats_json_uint(struct stats_json *json, const char *key, unsigned long long value)
+{
+	write_key(json, key);
+	json_printf(json, "%llu", value);
+}
+
+/** @brief Write a floating-point member */
+void stats_json_double(struct stats_json *json, const char *key, double value)
+{
+	write_key(json, key);
+	json_printf(json, "%.6f", value);
+}
+
+/** @brief Write a string member, escaping it as needed */
+void stats_json_string(struct stats_json *json, const char *key, const char *value)
+{
+	write_key(json, key);
+	json_printf(json, "\"");
+	for (const char *c = value; *c; c++) {
+		if (*c == '"' || *c == '\\')
+			json_printf(json, "\\%c", *c);
+		else if ((unsigned char)*c < 0x20)
+			json_printf(json, "\\u%04x", *c);
+		else
+			json_printf(json, "%c", *c);
+	}
+	json_printf(json, "\"");
+}
+
+/**
+ * @brief Write a member whose value is already formatted as JSON, e.g. a
+ * document written by another process; its lines are indented to match
+ */
+void stats_json_raw(struct stats_json *json, const char *key, const char *value)
+{
+	write_key(json, key);
+	for (const char *c = value; *c; c++) {
+		json_printf(json, "%c", *c);
+		if (*c == '\n')
+			json_printf(json, "%*s", 2 * json->depth, "");
+	}
+}
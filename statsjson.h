@@ -0,0 +1,31 @@
+/** @file statsjson.h
+ *  @brief A minimal writer for the machine-readable run statistics.
+ *
+ * Writes a single JSON object, with nested objects and number or string
+ * members, e.g. for the --stats-json file. Keys are written verbatim and
+ * should be plain identifiers.
+ */
+
+#ifndef __STATSJSON_H__
+#define __STATSJSON_H__
+
+/** @brief The state of a JSON document being written */
+struct stats_json {
+	/** @brief The file descriptor to write to */
+	int fd;
+	/** @brief The nesting depth of the object being written */
+	int depth;
+	/** @brief Does the object being written still have no members? */
+	bool empty;
+};
+
+void stats_json_begin(struct stats_json *json, int fd);
+void stats_json_end(struct stats_json *json);
+void stats_json_begin_object(struct stats_json *json, const char *key);
+void stats_json_end_object(struct stats_json *json);
+void stats_json_uint(struct stats_json *json, const char *key, unsigned long long value);
+void stats_json_double(struct stats_json *json, const char *key, double value);
+void stats_json_string(struct stats_json *json, const char *key, const char *value);
+void stats_json_raw(struct stats_json *json, const char *key, const char *value);
+
+#endif /* __STATSJSON_H__ */
@@ -0,0 +1,61 @@
+/**
+ * @file mixedsizerace.c
+ * @brief Data race checks on accesses of different sizes to the same word
+ *
+ * The main thread writes a 64-bit word with store_64(), which the race
+ * detector tracks as a single shadow cell, and then reads one of its bytes
+ * with load_8(), which splits the word back into per-byte cells. One thread
+ * then writes the whole word again with store_64() and sets a flag with a
+ * release store.
+ *
+ * By default, the other thread reads a byte of the word only once it has
+ * seen the flag with an acquire load, so no execution should report a data
+ * race. Given any argument (e.g. "test/mixedsizerace.o racy"), it instead
+ * reads the byte before looking at the flag, which must be reported as a race
+ * with the 64-bit store whichever runs first.
+ */
+#include <stdio.h>
+#include <threads.h>
+#include <stdatomic.h>
+
+#include "librace.h"
+#include "model-assert.h"
+
+static uint64_t word;
+static atomic_int flag;
+static int racy;
+
+static void a(void *obj)
+{
+	store_64(&word, 0x0101010101010101ULL);
+	atomic_store_explicit(&flag, 1, memory_order_release);
+}
+
+static void b(void *obj)
+{
+	uint8_t *bytes = (uint8_t *)&word;
+
+	if (racy)
+		printf("bytes[5] = %d\n", load_8(&bytes[5]));
+	if (atomic_load_explicit(&flag, memory_order_acquire) == 1)
+		MODEL_ASSERT(load_8(&bytes[5]) == 1);
+}
+
+int user_main(int argc, char **argv)
+{
+	thrd_t t1, t2;
+
+	racy = argc > 1;
+
+	store_64(&word, 0);
+	printf("bytes[3] = %d\n", load_8(&((uint8_t *)&word)[3]));
+
+	atomic_init(&flag, 0);
+	thrd_create(&t1, (thrd_start_t)&a, NULL);
+	thrd_create(&t2, (thrd_start_t)&b, NULL);
+
+	thrd_join(t1);
+	thrd_join(t2);
+
+	return 0;
+}
@@ -20,18 +20,21 @@ static void a(void *obj)
 {
 	int r1=atomic_load_explicit(&x, memory_order_wildcard(1));
 	atomic_store_explicit(&y, 1, memory_order_wildcard(2));
+	printf("r1=%d\n", r1);
 }
 
 static void b(void *obj)
 {
 	int r2=atomic_load_explicit(&y, memory_order_wildcard(3));
 	atomic_store_explicit(&z, 1, memory_order_wildcard(4));
+	printf("r2=%d\n", r2);
 }
 
 static void c(void *obj)
 {
 	int r3=atomic_load_explicit(&z, memory_order_wildcard(5));
 	atomic_store_explicit(&x, 1, memory_order_wildcard(6));
+	printf("r3=%d\n", r3);
 }
 
 
@@ -29,12 +29,14 @@ static void c(void *obj)
 {
 	int r1=atomic_load_explicit(&x, memory_order_wildcard(3));
 	int r2=atomic_load_explicit(&y, memory_order_wildcard(4));
+	printf("r1=%d r2=%d\n", r1, r2);
 }
 
 static void d(void *obj)
 {
 	int r3=atomic_load_explicit(&y, memory_order_wildcard(5));
 	int r4=atomic_load_explicit(&x, memory_order_wildcard(6));
+	printf("r3=%d r4=%d\n", r3, r4);
 }
 
 int user_main(int argc, char **argv)
@@ -20,6 +20,7 @@ static void b(void *obj)
 	atomic_store_explicit(&x, 1, memory_order_wildcard(1));
 	atomic_store_explicit(&y, 1, memory_order_wildcard(2));
 	int r1=atomic_load_explicit(&z, memory_order_wildcard(3));
+	printf("r1=%d\n", r1);
 }
 
 static void c(void *obj)
@@ -27,6 +28,7 @@ static void c(void *obj)
 	atomic_store_explicit(&z, 1, memory_order_wildcard(4));
 	atomic_store_explicit(&x, 1000, memory_order_wildcard(5));
 	int r2=atomic_load_explicit(&y, memory_order_wildcard(6));
+	printf("r2=%d\n", r2);
 }
 
 static void d(void *obj)
@@ -34,6 +36,7 @@ static void d(void *obj)
 	atomic_store_explicit(&z, 2, memory_order_wildcard(7));
 	atomic_store_explicit(&y, 1000, memory_order_wildcard(8));
 	int r3=atomic_load_explicit(&x, memory_order_wildcard(9));
+	printf("r3=%d\n", r3);
 }
 
 int user_main(int argc, char **argv)
@@ -32,6 +32,7 @@ static void c(void *obj)
 	int r1=atomic_load_explicit(&v, memory_order_wildcard(5));
 	int r2=atomic_load_explicit(&x, memory_order_wildcard(6));
 	int r3=atomic_load_explicit(&y, memory_order_wildcard(7));
+	printf("r1=%d r2=%d r3=%d\n", r1, r2, r3);
 }
 
 
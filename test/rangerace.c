@@ -0,0 +1,63 @@
+/**
+ * @file rangerace.c
+ * @brief Data race checks on ranges of memory
+ *
+ * One thread fills a buffer, checking the whole write with
+ * race_check_write_range(), and then sets a flag with a release store.
+ *
+ * By default, the other thread reads the buffer, checked with
+ * race_check_read_range(), only once it has seen the flag with an acquire
+ * load, so no execution should report a data race. Given any argument (e.g.
+ * "test/rangerace.o racy"), it instead reads one byte of the buffer with a
+ * plain load_8() before looking at the flag, which must be reported as a
+ * race with the range write.
+ */
+#include <stdio.h>
+#include <string.h>
+#include <threads.h>
+#include <stdatomic.h>
+
+#include "librace.h"
+#include "model-assert.h"
+
+#define BUF_SIZE 16
+
+static char buf[BUF_SIZE];
+static atomic_int flag;
+static int racy;
+
+static void a(void *obj)
+{
+	race_check_write_range(buf, sizeof(buf));
+	memset(buf, 1, sizeof(buf));
+	atomic_store_explicit(&flag, 1, memory_order_release);
+}
+
+static void b(void *obj)
+{
+	char copy[BUF_SIZE];
+
+	if (racy)
+		printf("buf[5] = %d\n", load_8(&buf[5]));
+	if (atomic_load_explicit(&flag, memory_order_acquire) == 1) {
+		race_check_read_range(buf, sizeof(buf));
+		memcpy(copy, buf, sizeof(buf));
+		MODEL_ASSERT(copy[0] == 1 && copy[BUF_SIZE - 1] == 1);
+	}
+}
+
+int user_main(int argc, char **argv)
+{
+	thrd_t t1, t2;
+
+	racy = argc > 1;
+
+	atomic_init(&flag, 0);
+	thrd_create(&t1, (thrd_start_t)&a, NULL);
+	thrd_create(&t2, (thrd_start_t)&b, NULL);
+
+	thrd_join(t1);
+	thrd_join(t2);
+
+	return 0;
+}
@@ -9,22 +9,12 @@
 #include "common.h"
 #include "threads-model.h"
 #include "action.h"
+#include "profile.h"
+#include "stackpool.h"
 
 /* global "model" object */
 #include "model.h"
 
-/** Allocate a stack for a new thread. */
-static void * stack_allocate(size_t size)
-{
-	return Thread_malloc(size);
-}
-
-/** Free a stack for a terminated thread. */
-static void stack_free(void *stack)
-{
-	Thread_free(stack);
-}
-
 /**
  * @brief Get the current Thread
  *
@@ -47,6 +37,8 @@ void thread_startup()
 {
 	Thread * curr_thread = thread_current();
 
+	profile_switch_end();
+
 	/* Add dummy "start" action, just to create a first clock vector */
 	model->switch_to_master(new ModelAction(THREAD_START, std::memory_order_seq_cst, curr_thread));
 
@@ -59,26 +51,46 @@ void thread_startup()
 
 /**
  * Create a thread context for a new thread so we can use
- * setcontext/getcontext/swapcontext to swap it out.
+ * model_switchcontext to swap it out.
  * @return 0 on success; otherwise, non-zero error condition
  */
 int Thread::create_context()
 {
-	int ret;
+	/* Initialize new managed context */
+	stack = stack_pool_get(id_to_int(id), model->params.stacksize);
+	return model_makecontext(&context, stack, model->params.stacksize,
+			thread_startup, model->get_system_context());
+}
 
-	ret = getcontext(&context);
-	if (ret)
-		return ret;
+/**
+ * @brief Save the part of this thread's stack which is in use
+ *
+ * The stacks live outside of the snapshotting heap, so a mid-execution
+ * snapshot must save (and a rollback to it restore) their contents.
+ *
+ * @param buf The buffer to append the contents to
+ */
+void Thread::save_stack(ModelVector<char> *buf) const
+{
+	if (!stack || is_complete())
+		return;
+	char *top = (char *)stack + model->params.stacksize;
+	char *sp = (char *)model_context_sp(&context);
+	if (!sp)
+		sp = (char *)stack;
+	buf->insert(buf->end(), sp, top);
+}
 
-	/* Initialize new managed context */
-	stack = stack_allocate(STACK_SIZE);
-	context.uc_stack.ss_sp = stack;
-	context.uc_stack.ss_size = STACK_SIZE;
-	context.uc_stack.ss_flags = 0;
-	context.uc_link = model->get_system_context();
-	makecontext(&context, thread_startup, 0);
-
-	return 0;
+/**
+ * @brief Restore the contents of this thread's stack, as saved by
+ * save_stack()
+ * @param data The saved contents
+ * @param len The length of the saved contents, in bytes
+ */
+void Thread::restore_stack(const char *data, size_t len)
+{
+	char *top = (char *)stack + model->params.stacksize;
+	memcpy(top - len, data, len);
 }
 
 /**
@@ -88,12 +100,15 @@ int Thread::create_context()
  * context is saved here.
  * @param ctxt Context to which we will swap. Must hold a valid system context.
  * @return Does not return, unless we return to Thread t's context. See
- * swapcontext(3) (returns 0 for success, -1 for failure).
+ * model_switchcontext() (returns 0 for success, -1 for failure).
  */
-int Thread::swap(Thread *t, ucontext_t *ctxt)
+int Thread::swap(Thread *t, model_context_t *ctxt)
 {
 	t->set_state(THREAD_READY);
-	return model_swapcontext(&t->context, ctxt);
+	profile_switch_begin();
+	int ret = model_switchcontext(&t->context, ctxt);
+	profile_switch_end();
+	return ret;
 }
 
 /**
@@ -102,23 +117,27 @@ int Thread::swap(Thread *t, ucontext_t *ctxt)
  * @param ctxt System context variable to which to save the current context.
  * @param t Thread to which we will swap. Must hold a valid user context.
  * @return Does not return, unless we return to the system context (ctxt). See
- * swapcontext(3) (returns 0 for success, -1 for failure).
+ * model_switchcontext() (returns 0 for success, -1 for failure).
  */
-int Thread::swap(ucontext_t *ctxt, Thread *t)
+int Thread::swap(model_context_t *ctxt, Thread *t)
 {
 	t->set_state(THREAD_RUNNING);
-	return model_swapcontext(ctxt, &t->context);
+	profile_switch_begin();
+	int ret = model_switchcontext(ctxt, &t->context);
+	profile_switch_end();
+	return ret;
 }
 
 
-/** Terminate a thread and free its stack. */
+/**
+ * Terminate a thread. Its stack stays in the stack pool, for the next thread
+ * with the same ID.
+ */
 void Thread::complete()
 {
 	ASSERT(!is_complete());
 	DEBUG("completed thread %d\n", id_to_int(get_id()));
 	state = THREAD_COMPLETED;
-	if (stack)
-		stack_free(stack);
 }
 
 /**
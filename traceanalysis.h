@@ -2,6 +2,8 @@
 #define TRACE_ANALYSIS_H
 #include "model.h"
 
+struct stats_json;
+
 
 class TraceAnalysis {
  public:
@@ -31,6 +33,12 @@ class TraceAnalysis {
 
 	virtual void finish() = 0;
 
+	/** The exportStats method is called once at the very end, when the
+	 *  run statistics are exported (see --stats-json). It should write
+	 *  the analysis's statistics as members of the (already open) JSON
+	 *  object given. */
+	virtual void exportStats(struct stats_json *json) {}
+
 	/** This method is used to inspect the normal/abnormal model
 	 * action. */
 	virtual void inspectModelAction(ModelAction *act) {}